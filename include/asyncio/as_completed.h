@@ -0,0 +1,138 @@
+#pragma once
+
+#include <asyncio/child_tasks.h>
+#include <asyncio/event_loop.h>
+#include <asyncio/exception.h>
+#include <asyncio/handle.h>
+#include <asyncio/task.h>
+#include <asyncio/utils/non_copyable.h>
+#include <asyncio/utils/void_value.h>
+
+// std
+#include <coroutine>
+#include <cstddef>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+
+namespace asyncio {
+
+// The results of a range of tasks in the order they finish:
+//
+//   auto completed = asyncio::as_completed(std::move(tasks));
+//   while (!completed.empty()) {
+//     auto [index, value] = co_await completed.next();
+//   }
+//
+// The tasks are scheduled when it is created, and put into a queue when they
+// finish, which next() takes from. The exception of a task is rethrown by the
+// next() which takes it, and the others can still be taken after it.
+// Destroying it destroys the tasks which haven't finished yet.
+//
+// It is for the tasks of an event loop, not of a WorkStealingScheduler.
+template <typename R>
+class AsCompleted : NonCopyable {
+  using Children = detail::ChildTasks<R, AsCompleted>;
+  friend Children;
+  using Slot = typename Children::Slot;
+
+ public:
+  template <std::ranges::forward_range Tasks>
+  explicit AsCompleted(Tasks&& tasks)
+      : children_(*this, std::forward<Tasks>(tasks)),
+        left_(children_.size()) {
+    children_.start();
+  }
+
+  // The tasks point to it.
+  AsCompleted(AsCompleted&&) = delete;
+
+  // No more results to take.
+  bool empty() const { return left_ == 0; }
+  // Results left to take, finished or not.
+  size_t size() const { return left_; }
+
+  // Awaits the next task to finish, or the first one finished and not taken
+  // yet, and returns its index in the range and its result. Throws
+  // NoResultError if empty().
+  [[nodiscard("should use co_await")]] auto next() {
+    if (empty()) [[unlikely]] {
+      throw NoResultError{};
+    }
+    return NextAwaiter{*this};
+  }
+
+ private:
+  struct NextAwaiter {
+    bool await_ready() const noexcept { return completed_.first_ != nullptr; }
+
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> caller) noexcept {
+      completed_.waiter_ = &caller.promise();
+      completed_.waiter_->set_state(HandleIdAndState::State::SUSPEND);
+      suspended_ = true;
+    }
+
+    std::pair<size_t, GetTypeIfVoid_t<R>> await_resume() {
+      suspended_ = false;
+      return completed_.take();
+    }
+
+    // The caller is destroyed while waiting.
+    ~NextAwaiter() {
+      if (suspended_) {
+        completed_.waiter_ = nullptr;
+      }
+    }
+
+    AsCompleted& completed_;
+    bool suspended_ = false;
+  };
+
+  void child_finished(Slot& child) {
+    if (last_ != nullptr) {
+      last_->next = &child;
+    } else {
+      first_ = &child;
+    }
+    last_ = &child;
+    if (waiter_ != nullptr) {
+      get_event_loop().set_handle_will_be_called_soon(
+          *std::exchange(waiter_, nullptr));
+    }
+  }
+
+  std::pair<size_t, GetTypeIfVoid_t<R>> take() {
+    Slot& child = *std::exchange(first_, first_->next);
+    if (first_ == nullptr) {
+      last_ = nullptr;
+    }
+    --left_;
+    // Its frame goes back to the pool even if more results are awaited.
+    auto task = std::move(*child.task);
+    child.task.reset();
+    if constexpr (std::is_void_v<R>) {
+      std::move(task).get_result();
+      return {child.index, VoidValue{}};
+    } else {
+      return {child.index, std::move(task).get_result()};
+    }
+  }
+
+  Children children_;
+  size_t left_;
+  // The queue of the tasks which are finished and not taken yet.
+  Slot* first_ = nullptr;
+  Slot* last_ = nullptr;
+  CoHandleManager* waiter_ = nullptr;
+};
+
+template <std::ranges::forward_range Tasks,
+          typename R = typename detail::TaskResult<
+              std::ranges::range_value_t<Tasks>>::type>
+  requires(!std::is_lvalue_reference_v<Tasks>)
+[[nodiscard]] AsCompleted<R> as_completed(Tasks&& tasks) {
+  return AsCompleted<R>{std::forward<Tasks>(tasks)};
+}
+
+}  // namespace asyncio
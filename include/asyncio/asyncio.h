@@ -1,13 +1,39 @@
 #pragma once
 
+#include <asyncio/as_completed.h>
 #include <asyncio/event_loop.h>
 #include <asyncio/gather.h>
+#include <asyncio/hedge.h>
+#include <asyncio/race.h>
+#include <asyncio/result.h>
+#include <asyncio/run_in_executor.h>
 #include <asyncio/scheduled_task.h>
 #include <asyncio/sleep.h>
+#include <asyncio/spawn.h>
 #include <asyncio/task.h>
+#include <asyncio/task_group.h>
+#include <asyncio/threadsafe.h>
 #include <asyncio/utils/dump_callstack.h>
 #include <asyncio/utils/future.h>
 #include <asyncio/wait_for.h>
+#include <asyncio/yield.h>
+
+#ifdef USE_SLOW_CALLBACK_CHECK
+#include <asyncio/loop_watchdog.h>
+#include <asyncio/slow_callback.h>
+#endif
+
+#ifdef USE_TASK_STATS
+#include <asyncio/task_stats.h>
+#endif
+
+#ifdef USE_TRACING
+#include <asyncio/tracing.h>
+#endif
+
+#ifdef USE_WORK_STEALING
+#include <asyncio/work_stealing_scheduler.h>
+#endif
 
 #ifndef NO_IO
 #include <asyncio/io/open_connection.h>
@@ -16,7 +42,11 @@
 #endif
 
 // std
+#include <cstddef>
+#include <functional>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
 namespace asyncio {
 
@@ -32,4 +62,54 @@ decltype(auto) run(Fut&& main_task) {
   }
 }
 
+// Run n event loops, one per thread. Each thread calls make_main(index) (or
+// make_main()) to create its own main task, and runs it to completion on its
+// loop. Tasks can't be shared among threads, so they are created there.
+// Return the results ordered by thread index (nothing if they are void), or
+// rethrow the first exception after all threads are joined.
+template <typename F>
+auto run_on_threads(size_t n, F&& make_main) {
+  auto invoke_main = [&make_main](size_t index) {
+    if constexpr (std::is_invocable_v<F&, size_t>) {
+      return std::invoke(make_main, index);
+    } else {
+      return std::invoke(make_main);
+    }
+  };
+  using R = std::remove_cvref_t<decltype(run(invoke_main(size_t{})))>;
+
+  std::vector<Result<R>> results(n);
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      threads.emplace_back([&invoke_main, &result = results[i], i] {
+        try {
+          if constexpr (std::is_void_v<R>) {
+            run(invoke_main(i));
+            result.return_void();
+          } else {
+            result.set_value(run(invoke_main(i)));
+          }
+        } catch (...) {
+          result.unhandled_exception();
+        }
+      });
+    }
+  }  // join
+
+  if constexpr (std::is_void_v<R>) {
+    for (auto& result : results) {
+      result.result();
+    }
+  } else {
+    std::vector<R> values;
+    values.reserve(n);
+    for (auto& result : results) {
+      values.push_back(std::move(result).result());
+    }
+    return values;
+  }
+}
+
 }  // namespace asyncio
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <asyncio/exception.h>
+#include <asyncio/handle.h>
+#include <asyncio/task.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+
+namespace asyncio {
+
+namespace detail {
+
+template <typename T>
+struct TaskResult {};
+
+template <typename R>
+struct TaskResult<Task<R>> : std::type_identity<R> {};
+
+// Tasks taken out of a range, or added up to a capacity, with their state in
+// one block. Each task gets a Slot, a handle which is its parent (as the task
+// awaiting it would be): the loop runs the slot when the task finishes, and
+// the slot calls parent.child_finished(slot). So there is no coroutine frame
+// per task to wait for it. Destroying them destroys the tasks which are still
+// running.
+template <typename R, typename Parent>
+class ChildTasks : NonCopyable {
+ public:
+  struct Slot final : CoHandleManager {
+    void run() final { parent->child_finished(*this); }
+
+    auto& promise() { return task->std_h_.promise(); }
+
+    Parent* parent = nullptr;
+    size_t index = 0;
+    std::optional<Task<R>> task;
+    // For the parent, e.g. to queue the slots which are done.
+    Slot* next = nullptr;
+  };
+
+  template <std::ranges::forward_range Tasks>
+  ChildTasks(Parent& parent, Tasks&& tasks)
+      : size_(static_cast<size_t>(std::ranges::distance(tasks))),
+        slots_(std::make_unique<Slot[]>(size_)) {
+    size_t i = 0;
+    for (auto&& task : tasks) {
+      if (!task.valid()) [[unlikely]] {
+        throw InvalidFuture{};
+      }
+      auto& slot = slots_[i];
+      slot.parent = &parent;
+      slot.index = i++;
+      slot.task.emplace(std::move(task));
+    }
+  }
+
+  // Room for capacity tasks, added one at a time by add().
+  ChildTasks(Parent& parent, size_t capacity)
+      : size_(0), slots_(std::make_unique<Slot[]>(capacity)) {
+    for (size_t i = 0; i < capacity; ++i) {
+      slots_[i].parent = &parent;
+      slots_[i].index = i;
+    }
+  }
+
+  // Only once all of them are taken, so that none runs if one is invalid.
+  void start() {
+    for (auto& slot : *this) {
+      start(slot);
+    }
+  }
+
+  // Takes one more task into the room made by the constructor, and starts it.
+  Slot& add(Task<R> task) {
+    if (!task.valid()) [[unlikely]] {
+      throw InvalidFuture{};
+    }
+    auto& slot = slots_[size_++];
+    slot.task.emplace(std::move(task));
+    start(slot);
+    return slot;
+  }
+
+  size_t size() const { return size_; }
+  Slot& operator[](size_t index) { return slots_[index]; }
+  Slot* begin() { return slots_.get(); }
+  Slot* end() { return slots_.get() + size_; }
+
+ private:
+  // A task which is done already is reported at once.
+  static void start(Slot& slot) {
+    if (slot.task->done()) {
+      slot.parent->child_finished(slot);
+      return;
+    }
+    auto& promise = slot.promise();
+    assert(!promise.parent_co_manager_ptr_);
+    promise.parent_co_manager_ptr_ = &slot;
+    promise.schedule();
+  }
+
+  size_t size_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+}  // namespace detail
+
+}  // namespace asyncio
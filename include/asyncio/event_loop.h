@@ -1,26 +1,132 @@
 #pragma once
 
 #include <asyncio/handle.h>
+#include <asyncio/utils/intrusive_list.h>
+#include <asyncio/utils/mpsc_queue.h>
 #include <asyncio/utils/non_copyable.h>
+#include <asyncio/utils/ring_buffer.h>
+
+#ifdef USE_TIMER_HEAP
+#include <asyncio/timer/timer_heap.h>
+#else
+#include <asyncio/timer/timing_wheel.h>
+#endif
 
 #ifndef NO_IO
 #include <asyncio/io/selector.h>
 #endif
 
+#ifdef USE_METRICS
+#include <asyncio/metrics.h>
+#endif
+
+#ifdef USE_TRACING
+#include <asyncio/tracing.h>
+#endif
+
+#ifdef USE_SLOW_CALLBACK_CHECK
+#include <asyncio/slow_callback.h>
+#endif
+
+// 3rd
+#include <fmt/core.h>
+
 // std
 #include <algorithm>
+#include <array>
+#include <cassert>
+#ifdef USE_SLOW_CALLBACK_CHECK
+#include <atomic>
+#endif
+#include <cerrno>
 #include <chrono>
 #include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
 #include <optional>
-#include <queue>
-#include <ranges>
-#include <unordered_set>
+#ifdef USE_SLOW_CALLBACK_CHECK
+#include <sstream>
+#endif
+#include <type_traits>
+#include <utility>
+
+#ifndef NO_IO
+// sys
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 namespace asyncio {
 
-class EventLoop : private NonCopyable {  // global variable
+namespace detail {
+
+// A callback sent to an event loop by another thread.
+struct InboxCall {
+  virtual ~InboxCall() = default;
+  virtual void call() noexcept = 0;
+
+  InboxCall* next = nullptr;
+};
+
+template <typename F>
+struct InboxCallImpl final : InboxCall {
+  explicit InboxCallImpl(F&& fn) : fn_(std::forward<F>(fn)) {}
+
+  void call() noexcept final { fn_(); }
+
+  std::decay_t<F> fn_;
+};
+
+// A task detached by spawn(), which its loop owns until it finishes, see
+// spawn.h.
+struct SpawnedTask : CoHandleManager, ListNode {
+  // Run by the task at its final suspend point, to free it.
+  void run() final;
+
+  // Rethrows the exception of the task, if any.
+  virtual void get_result() = 0;
+};
+
+#ifdef USE_WORK_STEALING
+// Takes the ready handles of the loop of a WorkStealingScheduler worker.
+class ReadySink {
+ public:
+  virtual void push(HandleIdAndState& handle) = 0;
+
+ protected:
+  ~ReadySink() = default;
+};
+#endif
+
+}  // namespace detail
+
+// Takes the exceptions which nobody awaits, e.g. those of the tasks of
+// spawn().
+using ExceptionHandler = std::function<void(std::exception_ptr)>;
+
+// The default handler.
+inline void print_unhandled_exception(std::exception_ptr exception) {
+  try {
+    std::rethrow_exception(exception);
+  } catch (const std::exception& e) {
+    std::cerr << fmt::format("Unhandled exception in a spawned task: {}\n",
+                             e.what());
+  } catch (...) {
+    std::cerr << "Unhandled exception in a spawned task\n";
+  }
+}
+
+class EventLoop : private NonCopyable {  // one per thread
   using MSDuration = std::chrono::milliseconds;
-  using PairTimerHandle = std::pair<MSDuration, HandleInfo>;
+#ifdef USE_TIMER_HEAP
+  using TimerQueue = TimerHeap;
+#else
+  using TimerQueue = TimingWheel;
+#endif
 
  public:
   EventLoop() {
@@ -32,22 +138,219 @@ class EventLoop : private NonCopyable {  // global variable
         std::chrono::duration_cast<MSDuration>(now.time_since_epoch());
   }
 
+  ~EventLoop() {
+    cancel_spawned();
+    // Callbacks which never ran. Their captures are destroyed here, e.g. the
+    // future of run_coroutine_threadsafe() gets std::future_error.
+    for (auto* call = inbox_.pop_all(); call != nullptr;) {
+      delete std::exchange(call, call->next);
+    }
+  }
+
   MSDuration time() {
     auto now = std::chrono::steady_clock::now();
     return std::chrono::duration_cast<MSDuration>(now.time_since_epoch()) -
            start_time_;
   }
 
-  // Don't cancel handle immediately.
-  // When a task will be run, if this task is in cancel set, ignore this task.
+  // A scheduled handle is either in the timer queue, which removes it at once,
+  // or in the ready queue, where its slot is cleared so that it is skipped.
+  // Nothing keeps a pointer to the handle afterwards, so it can be destroyed.
   void set_handle_cancelled(HandleIdAndState& handle) {
+    if (handle.get_state() != HandleIdAndState::State::SCHEDULED) {
+      return;
+    }
+    assert(handle.loop() == this);
     handle.set_state(HandleIdAndState::State::UNSCHEDULED);
-    cancelled_set_.insert(handle.get_handle_id());
+    if (auto& entry = handle.timer_entry(); entry.queued()) {
+      timers_.erase(entry);
+    } else if (auto& queue = ready_queue(handle.priority());
+               handle.ready_index() - queue.popped < queue.handles.size()) {
+      auto& slot = queue.handles[handle.ready_index() - queue.popped];
+      if (slot == &handle) {
+        slot = nullptr;
+      }
+    }
   }
 
   void set_handle_will_be_called_soon(HandleIdAndState& handle) {
+    // Already in the ready queue or the timer queue.
+    if (handle.get_state() == HandleIdAndState::State::SCHEDULED) {
+      return;
+    }
     handle.set_state(HandleIdAndState::State::SCHEDULED);
-    ready_q_.push(HandleInfo{handle.get_handle_id(), &handle});
+    handle.set_loop(this);
+#ifdef USE_TRACING
+    trace_event(TraceEventType::SCHEDULE, handle.get_handle_id());
+#endif
+#ifdef USE_TASK_STATS
+    handle.task_clock().scheduled();
+#endif
+#ifdef USE_WORK_STEALING
+    if (ready_sink_ != nullptr) [[unlikely]] {
+      ready_sink_->push(handle);
+      return;
+    }
+#endif
+    // A branch rather than an index, so that pushing doesn't wait for the
+    // priority to be loaded from the handle.
+    auto* queue = &ready_queue(Priority::NORMAL);
+    if (handle.priority() != Priority::NORMAL) [[unlikely]] {
+      queue = &ready_queue(handle.priority());
+    }
+    handle.set_ready_index(queue->popped + queue->handles.size());
+    queue->handles.push_back(&handle);
+    max_ready_queue_size_ =
+        std::max(max_ready_queue_size_, queue->handles.size());
+  }
+
+  // Call fn() soon on the thread of this loop. Unlike the other member
+  // functions, it can be called from any thread. It takes no lock, and wakes up
+  // the loop if it is waiting for IO. fn shouldn't throw.
+  template <typename F>
+  void call_soon_threadsafe(F&& fn) {
+    auto* call = new detail::InboxCallImpl<F>(std::forward<F>(fn));
+    if (inbox_.push(call)) {
+      // Only the first callback after the loop took the inbox wakes it.
+#ifndef NO_IO
+      selector_.notify();
+#endif
+    }
+  }
+
+  // A callback from another thread is on its way, e.g. when a job in a thread
+  // pool is done. The loop keeps running, waiting for it, until the callback
+  // calls threadsafe_call_received().
+  void expect_threadsafe_call() { ++expected_threadsafe_calls_; }
+  void threadsafe_call_received() { --expected_threadsafe_calls_; }
+
+#ifdef USE_WORK_STEALING
+  // Send ready handles to sink instead of the ready queue, or stop if it is
+  // nullptr. Used by the worker threads of a WorkStealingScheduler.
+  void set_ready_sink(detail::ReadySink* sink) { ready_sink_ = sink; }
+  detail::ReadySink* ready_sink() const { return ready_sink_; }
+#endif
+
+  // A handle can complete this many IO operations without suspending, e.g.
+  // reading from a socket which always has data, before it has to yield to
+  // the loop, so that other connections and timers get their turn (as the
+  // coop budget of tokio). 128 by default, 0 for no limit. With io_uring,
+  // every operation goes through the loop anyway.
+  void set_coop_budget(size_t budget) {
+    coop_budget_ = budget != 0 ? budget : SIZE_MAX;
+  }
+  size_t coop_budget() const {
+    return coop_budget_ != SIZE_MAX ? coop_budget_ : 0;
+  }
+
+  // Spend a unit of the coop budget of the running handle. false if it is
+  // used up: the caller should yield.
+  bool consume_coop_budget() noexcept {
+    if (coop_budget_left_ == 0) [[unlikely]] {
+      return false;
+    }
+    --coop_budget_left_;
+    return true;
+  }
+
+  // The longest the ready queue of a priority has been.
+  size_t max_ready_queue_size() const { return max_ready_queue_size_; }
+
+#ifdef USE_METRICS
+  // Unlike the other member functions, it can be used from any thread, e.g.
+  // loop.metrics().snapshot().
+  const LoopMetrics& metrics() const { return metrics_; }
+#endif
+
+#ifdef USE_SLOW_CALLBACK_CHECK
+  // Report the handles which run for at least duration (100 ms by default) to
+  // handler, or to print_slow_callback() without one. As debug mode in Python
+  // asyncio, it spots blocking calls in coroutines.
+  void set_slow_callback_duration(std::chrono::nanoseconds duration) {
+    slow_callback_duration_ = duration;
+  }
+  std::chrono::nanoseconds slow_callback_duration() const {
+    return slow_callback_duration_;
+  }
+  void set_slow_callback_handler(SlowCallbackHandler handler) {
+    slow_callback_handler_ = std::move(handler);
+  }
+
+  struct RunningCallback {
+    HandleId id;
+    std::chrono::steady_clock::time_point since;
+  };
+
+  // The handle being run now, if any. Unlike the other member functions, it
+  // can be called from any thread, e.g. by a LoopWatchdog.
+  std::optional<RunningCallback> running_callback() const {
+    using std::chrono::steady_clock;
+    int64_t since = running_since_ns_.load(std::memory_order_acquire);
+    HandleId id = running_id_.load(std::memory_order_relaxed);
+    // Another handle may have started meanwhile.
+    if (since == 0 ||
+        running_since_ns_.load(std::memory_order_relaxed) != since) {
+      return std::nullopt;
+    }
+    return RunningCallback{
+        .id = id,
+        .since = steady_clock::time_point(std::chrono::nanoseconds(since))};
+  }
+
+  // The running handle is being destroyed, see HandleIdAndState::set_running.
+  void running_handle_destroyed() { running_handle_ = nullptr; }
+
+  // The running handle goes on with to, e.g. a task finishing returns to its
+  // parent directly, which may destroy it.
+  void running_handle_transferred(HandleIdAndState& from,
+                                  HandleIdAndState& to) {
+    if (running_handle_ == &from) {
+      from.set_running(false);
+      to.set_running(true);
+      running_handle_ = &to;
+    }
+  }
+#endif
+
+  // Report the exceptions which nobody awaits to handler, or to
+  // print_unhandled_exception() without one.
+  void set_exception_handler(ExceptionHandler handler) {
+    exception_handler_ = std::move(handler);
+  }
+
+  void call_exception_handler(std::exception_ptr exception) {
+    if (exception_handler_) {
+      exception_handler_(std::move(exception));
+    } else {
+      print_unhandled_exception(std::move(exception));
+    }
+  }
+
+  // Tasks of spawn() which haven't finished yet.
+  size_t spawned_count() const { return spawned_count_; }
+
+  void add_spawned(detail::SpawnedTask& task) {
+    task.link_before(spawned_);
+    ++spawned_count_;
+  }
+
+  // Reports the exception of a spawned task which is done, and frees it.
+  void spawned_finished(detail::SpawnedTask& task) {
+    try {
+      task.get_result();
+    } catch (...) {
+      call_exception_handler(std::current_exception());
+    }
+    remove_spawned(task);
+  }
+
+  // Destroys the tasks of spawn() which haven't finished yet, with the timers
+  // and the waits for IO they are suspended in, e.g. at shutdown. The
+  // destructor does it too.
+  void cancel_spawned() {
+    while (spawned_.linked()) {
+      remove_spawned(*static_cast<detail::SpawnedTask*>(spawned_.next()));
+    }
   }
 
   template <typename Rep, typename Period>
@@ -64,6 +367,101 @@ class EventLoop : private NonCopyable {  // global variable
 
 #ifndef NO_IO
 
+#ifdef USE_IO_URING
+
+  // The operation is submitted to the ring in await_suspend(), and the
+  // coroutine is resumed with its result when it is completed.
+  template <typename Prepare>
+  struct IoOpAwaiter {
+    // NOLINTNEXTLINE(readability-convert-member-functions-to-static)
+    constexpr bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      handle.promise().set_state(HandleIdAndState::State::SUSPEND);
+      op_.handle_info = {.id = handle.promise().get_handle_id(),
+                         .handle = &handle.promise()};
+#ifdef USE_TRACING
+      trace_event(TraceEventType::IO_WAIT, op_.handle_info.id);
+#endif
+#ifdef USE_TASK_STATS
+      handle.promise().task_clock().io_wait_started();
+#endif
+      prepare_(selector_, op_);
+    }
+
+    int32_t await_resume() const noexcept { return op_.result; }
+
+    // If the coroutine is destroyed while waiting, the kernel may still use
+    // op_ and the buffer, so cancel it synchronously.
+    ~IoOpAwaiter() { selector_.cancel(op_); }
+
+    Selector& selector_;
+    Prepare prepare_;
+    IoUringOp op_{};
+  };
+
+  template <typename Prepare>
+  auto make_io_op_awaiter(Prepare prepare) {
+    return IoOpAwaiter<Prepare>{selector_, std::move(prepare)};
+  }
+
+  [[nodiscard]] auto wait_io_event(const IoEvent& event) {
+    return make_io_op_awaiter([fd = event.fd, type = event.event_type](
+                                  Selector& selector, IoUringOp& op) {
+      selector.prep_poll(op, fd, type);
+    });
+  }
+
+  // Result: number of bytes read, or -errno.
+  [[nodiscard]] auto async_read(int fd, void* buf, size_t len) {
+    return make_io_op_awaiter([=](Selector& selector, IoUringOp& op) {
+      selector.prep_read(op, fd, buf, len);
+    });
+  }
+
+  // Result: number of bytes written, or -errno.
+  [[nodiscard]] auto async_write(int fd, const void* buf, size_t len) {
+    return make_io_op_awaiter([=](Selector& selector, IoUringOp& op) {
+      selector.prep_write(op, fd, buf, len);
+    });
+  }
+
+  // Result: fd of the accepted socket, or -errno.
+  [[nodiscard]] auto async_accept(int fd, sockaddr* addr, socklen_t* len) {
+    return make_io_op_awaiter([=](Selector& selector, IoUringOp& op) {
+      selector.prep_accept(op, fd, addr, len);
+    });
+  }
+
+  // Result: 0 if connected, or -errno.
+  [[nodiscard]] auto async_connect(int fd, const sockaddr* addr,
+                                   socklen_t len) {
+    return make_io_op_awaiter([=](Selector& selector, IoUringOp& op) {
+      selector.prep_connect(op, fd, addr, len);
+    });
+  }
+
+  [[nodiscard]] auto async_read(IoRegistration& io, void* buf, size_t len) {
+    return async_read(io.fd(), buf, len);
+  }
+
+  [[nodiscard]] auto async_write(IoRegistration& io, const void* buf,
+                                 size_t len) {
+    return async_write(io.fd(), buf, len);
+  }
+
+  // The accepted socket is nonblocking.
+  [[nodiscard]] auto async_accept(IoRegistration& io, sockaddr* addr,
+                                  socklen_t* len) {
+    return make_io_op_awaiter([=, fd = io.fd()](Selector& selector,
+                                                IoUringOp& op) {
+      selector.prep_accept(op, fd, addr, len, SOCK_NONBLOCK);
+    });
+  }
+
+#else
+
   struct WaitEventAwaiter {
     // NOLINTNEXTLINE(readability-convert-member-functions-to-static)
     constexpr bool await_ready() const noexcept { return false; }
@@ -74,6 +472,12 @@ class EventLoop : private NonCopyable {  // global variable
       handle.promise().set_state(HandleIdAndState::State::SUSPEND);
       event_.handle_info = {.id = handle.promise().get_handle_id(),
                             .handle = &handle.promise()};
+#ifdef USE_TRACING
+      trace_event(TraceEventType::IO_WAIT, event_.handle_info.id);
+#endif
+#ifdef USE_TASK_STATS
+      handle.promise().task_clock().io_wait_started();
+#endif
       selector_.register_event(event_);
     }
 
@@ -85,10 +489,184 @@ class EventLoop : private NonCopyable {  // global variable
     IoEvent event_;
   };
 
+  // Wait until the fd is ready, then run the syscall once.
+  template <typename Syscall>
+  struct IoOpAwaiter : WaitEventAwaiter {
+    auto await_resume() noexcept { return syscall_(); }
+
+    Syscall syscall_;
+  };
+
+  template <typename Syscall>
+  auto make_io_op_awaiter(const IoEvent& event, Syscall syscall) {
+    return IoOpAwaiter<Syscall>{{selector_, event}, std::move(syscall)};
+  }
+
   [[nodiscard]] auto wait_io_event(const IoEvent& event) {
     return WaitEventAwaiter{selector_, event};
   }
 
+  // Result: number of bytes read, or -errno.
+  [[nodiscard]] auto async_read(int fd, void* buf, size_t len) {
+    IoEvent event{.fd = fd, .event_type = EPOLLIN, .handle_info = {}};
+    return make_io_op_awaiter(event, [=] {
+      return syscall_result(::read(fd, buf, len));
+    });
+  }
+
+  // Result: number of bytes written, or -errno.
+  [[nodiscard]] auto async_write(int fd, const void* buf, size_t len) {
+    IoEvent event{.fd = fd, .event_type = EPOLLOUT, .handle_info = {}};
+    return make_io_op_awaiter(event, [=] {
+      return syscall_result(::write(fd, buf, len));
+    });
+  }
+
+  // Result: fd of the accepted socket, or -errno.
+  [[nodiscard]] auto async_accept(int fd, sockaddr* addr, socklen_t* len) {
+    IoEvent event{.fd = fd, .event_type = EPOLLIN, .handle_info = {}};
+    return make_io_op_awaiter(event, [=] {
+      return syscall_result(::accept(fd, addr, len));
+    });
+  }
+
+  // connect() on a nonblocking socket returns EINPROGRESS at first, and the
+  // socket becomes writable when the connection is established or failed.
+  struct ConnectAwaiter : WaitEventAwaiter {
+    bool await_ready() noexcept {
+      /// https://man7.org/linux/man-pages/man2/connect.2.html
+      /// connect - initiate a connection on a socket
+      result_ = syscall_result(::connect(event_.fd, addr_, len_));
+      return result_ != -EINPROGRESS;
+    }
+
+    int await_resume() noexcept {
+      if (result_ == -EINPROGRESS) {
+        int error = 0;
+        socklen_t error_len = sizeof error;
+        /// https://man7.org/linux/man-pages/man2/getsockopt.2.html
+        if (getsockopt(event_.fd, SOL_SOCKET, SO_ERROR, &error, &error_len) <
+            0) {
+          error = errno;
+        }
+        result_ = -error;
+      }
+      return result_;
+    }
+
+    const sockaddr* addr_;
+    socklen_t len_;
+    int result_ = 0;
+  };
+
+  // Result: 0 if connected, or -errno.
+  [[nodiscard]] auto async_connect(int fd, const sockaddr* addr,
+                                   socklen_t len) {
+    IoEvent event{.fd = fd, .event_type = EPOLLOUT, .handle_info = {}};
+    return ConnectAwaiter{{selector_, event}, addr, len};
+  }
+
+  // Try the syscall first, and only wait (without any epoll_ctl once the fd is
+  // registered) if it would block. If it is done at once but the coop budget
+  // of the task is used up, yield to the loop before returning its result.
+  template <typename Syscall>
+  struct RegisteredIoAwaiter {
+    bool await_ready() noexcept {
+      result_ = syscall_();
+      return result_ != -EAGAIN && loop_.consume_coop_budget();
+    }
+
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      if (result_ != -EAGAIN) {
+        loop_.set_handle_will_be_called_soon(handle.promise());
+        return;
+      }
+      handle.promise().set_state(HandleIdAndState::State::SUSPEND);
+      waiting_id_ = handle.promise().get_handle_id();
+#ifdef USE_TRACING
+      trace_event(TraceEventType::IO_WAIT, *waiting_id_);
+#endif
+#ifdef USE_TASK_STATS
+      handle.promise().task_clock().io_wait_started();
+#endif
+      io_.wait(event_type_,
+               {.id = *waiting_id_, .handle = &handle.promise()});
+    }
+
+    // May still be -EAGAIN if someone else drained the fd first.
+    auto await_resume() noexcept {
+      if (waiting_id_.has_value()) {
+        result_ = syscall_();
+      }
+      return result_;
+    }
+
+    ~RegisteredIoAwaiter() {
+      if (waiting_id_.has_value()) {
+        io_.cancel_wait(event_type_, *waiting_id_);
+      }
+    }
+
+    EventLoop& loop_;
+    IoRegistration& io_;
+    uint32_t event_type_;
+    Syscall syscall_;
+    decltype(syscall_()) result_{};
+    std::optional<HandleId> waiting_id_{};
+  };
+
+  template <typename Syscall>
+  auto make_registered_io_awaiter(IoRegistration& io, uint32_t event_type,
+                                  Syscall syscall) {
+    return RegisteredIoAwaiter<Syscall>{*this, io, event_type,
+                                        std::move(syscall)};
+  }
+
+  // Result: number of bytes read, or -errno.
+  [[nodiscard]] auto async_read(IoRegistration& io, void* buf, size_t len) {
+    return make_registered_io_awaiter(io, EPOLLIN, [&io, buf, len] {
+      return syscall_result(::read(io.fd(), buf, len));
+    });
+  }
+
+  // Result: number of bytes written, or -errno.
+  [[nodiscard]] auto async_write(IoRegistration& io, const void* buf,
+                                 size_t len) {
+    return make_registered_io_awaiter(io, EPOLLOUT, [&io, buf, len] {
+      return syscall_result(::write(io.fd(), buf, len));
+    });
+  }
+
+  // Result: fd of the accepted socket (nonblocking), or -errno.
+  [[nodiscard]] auto async_accept(IoRegistration& io, sockaddr* addr,
+                                  socklen_t* len) {
+    return make_registered_io_awaiter(io, EPOLLIN, [&io, addr, len] {
+      /// https://man7.org/linux/man-pages/man2/accept.2.html
+      return syscall_result(::accept4(io.fd(), addr, len, SOCK_NONBLOCK));
+    });
+  }
+
+  template <typename R>
+  static R syscall_result(R ret) noexcept {
+    return ret < 0 ? -errno : ret;
+  }
+
+#endif
+
+  // Max number of IO events handled per wakeup of the selector. The others
+  // are handled by the next run_once().
+  void set_max_io_events(size_t max_events) {
+    selector_.set_max_events(max_events);
+  }
+
+  size_t max_io_events() const { return selector_.max_events(); }
+
+  // Try-first operations on a registered fd need it to be nonblocking.
+  [[nodiscard]] IoRegistration make_io_registration(int fd) {
+    return IoRegistration{selector_, fd};
+  }
+
 #endif
 
  private:
@@ -96,122 +674,293 @@ class EventLoop : private NonCopyable {  // global variable
   void run_once() {
     // Use epoll_wait() to check if some IO tasks are ready.
     check_io_event();
+#ifdef USE_METRICS
+    auto begin = std::chrono::steady_clock::now();
+#endif
+    // Run callbacks sent by other threads.
+    run_inbox();
     // Wake up scheduled tasks if time is up.
     wake_up_scheduled_task_if_ready();
-    // Run tasks in ready queue. If it has been in cancelled set, don't run it.
+    // Run tasks in ready queue. If it has been cancelled, don't run it.
     run_ready_tasks();
-    // If the front of scheduled tasks is in cancelled set. Pop it and discard.
-    remove_cancelled_scheduled_tasks();
+#ifdef USE_METRICS
+    update_metrics(begin);
+#endif
   }
 
+#ifdef USE_METRICS
+  void update_metrics(std::chrono::steady_clock::time_point begin) {
+    std::chrono::nanoseconds busy = std::chrono::steady_clock::now() - begin;
+    metrics_.iteration_ns.record(busy.count());
+    metrics_.iterations.add();
+    metrics_.ready_queue_size.set(ready_size());
+    metrics_.max_ready_queue_size.set(max_ready_queue_size_);
+    metrics_.timers.set(timers_.size());
+#ifndef NO_IO
+    metrics_.io_waiting.set(selector_.waiting_count());
+    metrics_.io_registered.set(selector_.registered_count());
+#endif
+  }
+#endif
+
   void check_io_event() {
 #ifndef NO_IO
     // Use in epoll_wait(). std::nullopt means epoll_wait(timeout=-1).
     std::optional<MSDuration> io_event_timeout;
-    if (!ready_q_.empty()) {
+    if (ready_size() != 0) {
       // If some task are ready, epoll_wait(timeout=0).
       io_event_timeout.emplace(0);
-    } else if (!schedule_pq_.empty()) {
+    } else if (auto when = timers_.next_expiry()) {
       // No task is ready, but some task are slept.
-      auto& when = schedule_pq_[0].first;
-      io_event_timeout = std::max(when - time(), MSDuration(0));
+      io_event_timeout = std::max(*when - time(), MSDuration(0));
     }
 
     // Wait for some selector event with specified timeout.
     // If no ready or scheduled task, epoll_wait() infinitely until one event is
     // delivered. If timeout is 0, epoll_wait() with return immediately.
-    auto event_list = selector_.select(
-        io_event_timeout.has_value() ? (int)io_event_timeout->count() : -1);
-    for (auto&& event : event_list) {
-      // send selector event into ready queue.
-      ready_q_.push(event.handle_info);
-    }
+    // Woken up coroutines go into the ready queue straight from the event
+    // buffer of the selector.
+    selector_.select(
+        io_event_timeout.has_value() ? (int)io_event_timeout->count() : -1,
+        [this](HandleIdAndState& handle) {
+#ifdef USE_METRICS
+          metrics_.io_events.add();
+#endif
+#ifdef USE_TRACING
+          trace_event(TraceEventType::IO_READY, handle.get_handle_id());
+#endif
+#ifdef USE_TASK_STATS
+          handle.task_clock().io_wait_ended();
+#endif
+          set_handle_will_be_called_soon(handle);
+        });
 #endif
   }
 
   void wake_up_scheduled_task_if_ready() {
-    auto end_time = time();
+#ifdef USE_METRICS
+    // Deadlines are in ms since start_time_.
+    auto now = std::chrono::steady_clock::now().time_since_epoch() -
+               start_time_;
+#endif
     // Some scheduled task can wake up when epoll_wait() blocks.
-    while (!schedule_pq_.empty()) {
-      auto&& [when, handle_info] = schedule_pq_[0];
-      if (when >= end_time) break;
+    timers_.expire(time(), [&](TimerEntry& entry) {
+#ifdef USE_METRICS
+      metrics_.timers_fired.add();
+      std::chrono::nanoseconds lag = now - entry.when;
+      metrics_.timer_lag_ns.record(std::max<int64_t>(lag.count(), 0));
+#endif
       // send into ready queue
-      ready_q_.push(handle_info);
-      // pop_heap() with "greater{}" moves the smallest to the end. No pop.
-      std::ranges::pop_heap(schedule_pq_, std::ranges::greater{},
-                            &PairTimerHandle::first);
-      schedule_pq_.pop_back();
+      entry.handle->set_state(HandleIdAndState::State::UNSCHEDULED);
+      set_handle_will_be_called_soon(*entry.handle);
+    });
+  }
+
+  void run_inbox() {
+    for (auto* call = inbox_.pop_all(); call != nullptr;) {
+      std::unique_ptr<detail::InboxCall> current(
+          std::exchange(call, call->next));
+      current->call();
+#ifdef USE_METRICS
+      metrics_.threadsafe_calls.add();
+#endif
     }
   }
 
+  // Run the handles which are ready now, the higher priorities first, and
+  // in order among the same priority. Those scheduled meanwhile wait for the
+  // next run_once(), so IO and timers are checked in between, except HIGH
+  // ones, which run before the next handle of lower priority.
+  // BACKGROUND handles get one run per kBackgroundShare runs of the others,
+  // and at least kMinBackgroundBatch: a burst of them doesn't keep the loop
+  // from IO for long, and they aren't starved by the others.
   void run_ready_tasks() {
-    for (size_t i = 0, n_ready = ready_q_.size(); i < n_ready; ++i) {
-      auto [handle_id, handle_manager] = ready_q_.front();
-      ready_q_.pop();
-      if (auto iter = cancelled_set_.find(handle_id);
-          iter != cancelled_set_.end()) {
-        // If handle_id is a cancelled task. Don't run this task and remove it
-        // from cancelled task.
-        cancelled_set_.erase(iter);
-      } else {
+    size_t n_high = ready_queue(Priority::HIGH).handles.size();
+    size_t n_normal = ready_queue(Priority::NORMAL).handles.size();
+    size_t n_background =
+        std::min(ready_queue(Priority::BACKGROUND).handles.size(),
+                 std::max(kMinBackgroundBatch,
+                          (n_high + n_normal) / kBackgroundShare));
+#ifdef USE_METRICS
+    metrics_.ready_batch.record(n_high + n_normal + n_background);
+#endif
+    [[maybe_unused]] size_t n_run =
+        run_ready(Priority::HIGH, n_high) +
+        run_ready(Priority::NORMAL, n_normal) +
+        run_ready(Priority::BACKGROUND, n_background);
+    detail::running_priority = Priority::NORMAL;
+#ifdef USE_METRICS
+    metrics_.handles_run.add(n_run);
+#endif
+  }
+
+  // Run the first n handles of the queue of priority, and return how many
+  // were not cancelled, including the HIGH ones run in between.
+  size_t run_ready(Priority priority, size_t n) {
+    auto& queue = ready_queue(priority);
+    auto& high = ready_queue(Priority::HIGH);
+    size_t n_run = 0;
+    detail::running_priority = priority;
+    for (size_t i = 0; i < n; ++i) {
+      if (priority != Priority::HIGH && !high.handles.empty()) [[unlikely]] {
+        n_run += run_ready(Priority::HIGH, high.handles.size());
+        detail::running_priority = priority;
+      }
+      auto* handle = queue.handles.front();
+      queue.handles.pop_front();
+      ++queue.popped;
+      // Fetch the next handle into the cache while this one runs, it is in
+      // another coroutine frame somewhere else in memory.
+      if (i + 1 < n && queue.handles.front() != nullptr) {
+        __builtin_prefetch(queue.handles.front());
+      }
+      // nullptr if the handle has been cancelled.
+      if (handle != nullptr) {
         // When running, the state may be changed. So unschedule it first.
-        handle_manager->set_state(HandleIdAndState::State::UNSCHEDULED);
-        handle_manager->run();
+        handle->set_state(HandleIdAndState::State::UNSCHEDULED);
+        coop_budget_left_ = coop_budget_;
+#ifdef USE_SYMMETRIC_TRANSFER
+        detail::symmetric_transfers = 0;
+#endif
+#ifdef USE_SLOW_CALLBACK_CHECK
+        run_timed(*handle);
+#else
+        handle->run();
+#endif
+        ++n_run;
       }
     }
+    return n_run;
   }
 
-  void remove_cancelled_scheduled_tasks() {
-    // If the first task in scheduled queue has been in cancelled set,
-    // cancel it (remove it from schedule queue).
-    while (!schedule_pq_.empty()) {
-      auto& handle_info = schedule_pq_[0].second;
-      if (auto it = cancelled_set_.find(handle_info.id);
-          it != cancelled_set_.end()) {
-        std::ranges::pop_heap(schedule_pq_, std::ranges::greater{},
-                              &PairTimerHandle::first);
-        schedule_pq_.pop_back();
-        cancelled_set_.erase(it);
-      } else {
-        break;
-      }
+#ifdef USE_SLOW_CALLBACK_CHECK
+  void run_timed(HandleIdAndState& handle) {
+    auto begin = std::chrono::steady_clock::now();
+    HandleId id = handle.get_handle_id();
+    running_handle_ = &handle;
+    handle.set_running(true);
+    running_id_.store(id, std::memory_order_relaxed);
+    running_since_ns_.store(
+        std::chrono::nanoseconds(begin.time_since_epoch()).count(),
+        std::memory_order_release);
+
+    handle.run();
+
+    running_since_ns_.store(0, std::memory_order_relaxed);
+    // nullptr if run() destroyed it, e.g. a task destroyed by its parent.
+    auto* alive = std::exchange(running_handle_, nullptr);
+    if (alive != nullptr) {
+      alive->set_running(false);
+    }
+    std::chrono::nanoseconds duration =
+        std::chrono::steady_clock::now() - begin;
+    if (duration >= slow_callback_duration_) [[unlikely]] {
+      report_slow_callback(alive, id, duration);
+    }
+  }
+
+  void report_slow_callback(const HandleIdAndState* handle, HandleId id,
+                            std::chrono::nanoseconds duration) {
+    SlowCallback slow{.id = id, .duration = duration, .finished = true};
+    if (auto* manager = dynamic_cast<const CoHandleManager*>(handle)) {
+      std::ostringstream backtrace;
+      manager->dump_backtrace(0, backtrace);
+      slow.backtrace = std::move(backtrace).str();
+    }
+    if (slow_callback_handler_) {
+      slow_callback_handler_(slow);
+    } else {
+      print_slow_callback(slow);
     }
   }
+#endif
 
   bool is_stop() {
     bool is_selector_empty = true;
 #ifndef NO_IO
     is_selector_empty = selector_.is_stop();
 #endif
-    return schedule_pq_.empty() && ready_q_.empty() && is_selector_empty;
+    return timers_.empty() && ready_size() == 0 && inbox_.empty() &&
+           expected_threadsafe_calls_ == 0 && is_selector_empty;
+  }
+
+  struct ReadyQueue {
+    RingBuffer<HandleIdAndState*> handles;
+    // Number of handles ever popped from handles, so handle.ready_index() -
+    // popped is the position of a scheduled handle in it.
+    size_t popped = 0;
+  };
+
+  ReadyQueue& ready_queue(Priority priority) {
+    return ready_queues_[static_cast<size_t>(priority)];
+  }
+
+  // Of all priorities.
+  size_t ready_size() const {
+    size_t size = 0;
+    for (const auto& queue : ready_queues_) {
+      size += queue.handles.size();
+    }
+    return size;
+  }
+
+  void remove_spawned(detail::SpawnedTask& task) {
+    task.unlink();
+    --spawned_count_;
+    delete &task;
   }
 
   template <typename Rep, typename Period>
   void call_at(std::chrono::duration<Rep, Period> when,
                HandleIdAndState& callback) {
-    // push the task into schedule queue.
+    // push the task into timer queue.
     callback.set_state(HandleIdAndState::State::SCHEDULED);
-    schedule_pq_.emplace_back(std::chrono::duration_cast<MSDuration>(when),
-                              HandleInfo{callback.get_handle_id(), &callback});
-    std::ranges::push_heap(schedule_pq_, std::ranges::greater{},
-                           &PairTimerHandle::first);
+    callback.set_loop(this);
+    timers_.insert(callback.timer_entry(),
+                   std::chrono::duration_cast<MSDuration>(when));
   }
 
  private:
   MSDuration start_time_{};
-  // struct HandleInfo {
-  //    HandleId id;
-  //    HandleIdAndState* handle;
-  //  };
-  std::queue<HandleInfo> ready_q_;
-  // using PairTimerHandle = std::pair<MSDuration, HandleInfo>;
-  std::vector<PairTimerHandle> schedule_pq_;  // priority_queue
-  std::unordered_set<HandleId> cancelled_set_;
+  constexpr static size_t kBackgroundShare = 8;
+  constexpr static size_t kMinBackgroundBatch = 64;
+  std::array<ReadyQueue, kPriorities> ready_queues_;
+  // SIZE_MAX for no limit.
+  size_t coop_budget_ = 128;
+  size_t coop_budget_left_ = coop_budget_;
+  size_t max_ready_queue_size_ = 0;
+#ifdef USE_WORK_STEALING
+  detail::ReadySink* ready_sink_ = nullptr;
+#endif
+#ifdef USE_METRICS
+  LoopMetrics metrics_;
+#endif
+#ifdef USE_SLOW_CALLBACK_CHECK
+  std::chrono::nanoseconds slow_callback_duration_ =
+      std::chrono::milliseconds(100);
+  SlowCallbackHandler slow_callback_handler_;
+  HandleIdAndState* running_handle_ = nullptr;
+  // Of running_handle_, for other threads. running_since_ns_ is 0 between
+  // handles.
+  std::atomic<HandleId> running_id_{0};
+  std::atomic<int64_t> running_since_ns_{0};
+#endif
+  ExceptionHandler exception_handler_;
+  ListNode spawned_;
+  size_t spawned_count_ = 0;
+  MpscQueue<detail::InboxCall> inbox_;
+  size_t expected_threadsafe_calls_ = 0;
+  TimerQueue timers_;
 #ifndef NO_IO
   Selector selector_;
 #endif
 };
 
+// Event loop of the calling thread.
 EventLoop& get_event_loop();
 
+inline void detail::SpawnedTask::run() {
+  get_event_loop().spawned_finished(*this);
+}
+
 }  // namespace asyncio
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <asyncio/child_tasks.h>
 #include <asyncio/handle.h>
 #include <asyncio/task.h>
 #include <asyncio/utils/awaitable.h>
@@ -7,12 +8,18 @@
 #include <asyncio/utils/void_value.h>
 
 // std
+#include <array>
+#ifdef USE_WORK_STEALING
+#include <atomic>
+#endif
 #include <exception>
+#include <ranges>
 #include <stdexcept>
 #include <tuple>
 #include <type_traits>
 #include <utility>
 #include <variant>
+#include <vector>
 
 namespace asyncio {
 
@@ -23,6 +30,30 @@ class GatherAwaiter : NonCopyable {
   using ResultTypes = std::tuple<GetTypeIfVoid_t<Rs>...>;
 
  public:
+#ifdef USE_WORK_STEALING
+  // The children may run on other threads of a WorkStealingScheduler, so the
+  // caller waits for join_, which awaits each of them in turn. Even if one of
+  // them throws, all of them finish before the caller is resumed, since their
+  // frames can't be destroyed while running elsewhere.
+  bool await_ready() { return join_.operator co_await().await_ready(); }
+
+  template <typename Promise>
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<Promise> continuation) noexcept {
+    return join_.operator co_await().await_suspend(continuation);
+  }
+
+  auto await_resume() const {
+    join_.operator co_await().await_resume();
+    // The first exception in argument order.
+    for (const auto& exception : exceptions_) {
+      if (exception) {
+        std::rethrow_exception(exception);
+      }
+    }
+    return std::get<ResultTypes>(result_);
+  }
+#else
   constexpr bool await_ready() noexcept { return is_finished(); }
 
   constexpr auto await_resume() const {
@@ -42,6 +73,7 @@ class GatherAwaiter : NonCopyable {
     // continuation_
     continuation_->set_state(HandleIdAndState::State::SUSPEND);
   }
+#endif
 
   template <concepts::Awaitable... Futs>
   explicit GatherAwaiter(Futs&&... futs)
@@ -52,7 +84,13 @@ class GatherAwaiter : NonCopyable {
   template <concepts::Awaitable... Futs, size_t... Is>
   explicit GatherAwaiter(std::index_sequence<Is...>, Futs&&... futs)
       : tasks_{std::make_tuple(collect_result<Is>(
-            resume_at_initial_suspend, std::forward<Futs>(futs))...)} {}
+            resume_at_initial_suspend, std::forward<Futs>(futs))...)}
+#ifdef USE_WORK_STEALING
+        ,
+        join_(join(resume_at_initial_suspend, std::index_sequence<Is...>{}))
+#endif
+  {
+  }
 
   template <size_t Idx, concepts::Awaitable Fut>
   Task<> collect_result(ResumeAtInitialSuspend, Fut&& fut) {
@@ -63,24 +101,50 @@ class GatherAwaiter : NonCopyable {
       } else {
         std::get<Idx>(results) = std::move(co_await std::forward<Fut>(fut));
       }
+#ifndef USE_WORK_STEALING
       ++count_;
+#endif
     } catch (...) {
+#ifdef USE_WORK_STEALING
+      exceptions_[Idx] = std::current_exception();
+#else
       result_ = std::current_exception();
+#endif
     }
-    if (is_finished()) {
+#ifndef USE_WORK_STEALING
+    // All tasks may finish before await_suspend() (they don't always suspend),
+    // then await_ready() is true and there is no continuation.
+    if (is_finished() && continuation_ != nullptr) {
       get_event_loop().set_handle_will_be_called_soon(*continuation_);
     }
+#endif
   }
 
+#ifdef USE_WORK_STEALING
+  template <size_t... Is>
+  Task<> join(ResumeAtInitialSuspend, std::index_sequence<Is...>) {
+    (co_await std::get<Is>(tasks_), ...);
+  }
+#else
   bool is_finished() {
     return (count_ == sizeof...(Rs) ||
             std::get_if<std::exception_ptr>(&result_) != nullptr);
   }
+#endif
 
   std::variant<ResultTypes, std::exception_ptr> result_;
-  std::tuple<asyncio::Task<std::void_t<Rs>>...> tasks_;
+  // Initialized before tasks_, which start running in the constructor.
+#ifdef USE_WORK_STEALING
+  // One per child, so that they don't race to set result_.
+  std::array<std::exception_ptr, sizeof...(Rs)> exceptions_{};
+#else
   CoHandleManager* continuation_{};
   int count_{0};
+#endif
+  std::tuple<asyncio::Task<std::void_t<Rs>>...> tasks_;
+#ifdef USE_WORK_STEALING
+  Task<> join_;
+#endif
 };
 
 template <concepts::Awaitable... Futs>  // C++17 deduction guide
@@ -122,6 +186,131 @@ auto gather(ResumeAtInitialSuspend,
   co_return co_await GatherAwaiterRepository{std::forward<Futs>(futs)...};
 }
 
+// Awaits a range of tasks decided at runtime, which report to it through
+// ChildTasks, so there is no coroutine per child as in GatherAwaiter.
+template <typename R>
+class RangeGatherAwaiter : NonCopyable {
+  using Children = ChildTasks<R, RangeGatherAwaiter>;
+  friend Children;
+
+ public:
+  // Takes the tasks out of the range and schedules them.
+  template <std::ranges::forward_range Tasks>
+  explicit RangeGatherAwaiter(Tasks&& tasks)
+      : children_(*this, std::forward<Tasks>(tasks)),
+#ifdef USE_WORK_STEALING
+        // One more for the caller, see await_suspend().
+        pending_(children_.size() + 1)
+#else
+        pending_(children_.size())
+#endif
+  {
+    children_.start();
+  }
+
+  // The children point to it.
+  RangeGatherAwaiter(RangeGatherAwaiter&&) = delete;
+
+#ifdef USE_WORK_STEALING
+  // The children may run on other threads, so all of them finish before the
+  // caller is resumed, and pending_ counts the caller as well: whoever is
+  // last, a child or the caller once suspended, resumes it.
+  bool await_ready() const noexcept {
+    return pending_.load(std::memory_order_acquire) == 1;
+  }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> continuation) noexcept {
+    continuation_ = &continuation.promise();
+    continuation_->set_state(HandleIdAndState::State::SUSPEND);
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      continuation_->set_state(HandleIdAndState::State::UNSCHEDULED);
+      return false;
+    }
+    return true;
+  }
+#else
+  // Done when all children are, or as soon as one of them throws: the others
+  // are destroyed with the awaiter.
+  bool await_ready() const noexcept {
+    return pending_ == 0 || failed_ != nullptr;
+  }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> continuation) noexcept {
+    continuation_ = &continuation.promise();
+    continuation_->set_state(HandleIdAndState::State::SUSPEND);
+  }
+#endif
+
+  // The results in the order of the range, or the first exception: in the
+  // order of the range with work stealing, else the first thrown.
+  auto await_resume() {
+#ifndef USE_WORK_STEALING
+    if (failed_ != nullptr) {
+      failed_->promise().result();  // rethrows
+    }
+#endif
+    std::vector<GetTypeIfVoid_t<R>> results;
+    results.reserve(children_.size());
+    for (auto& child : children_) {
+      if constexpr (std::is_void_v<R>) {
+        child.promise().result();
+        results.emplace_back();
+      } else {
+        results.push_back(std::move(child.promise()).result());
+      }
+    }
+    return results;
+  }
+
+ private:
+  void child_finished([[maybe_unused]] typename Children::Slot& child) {
+#ifdef USE_WORK_STEALING
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      get_event_loop().set_handle_will_be_called_soon(*continuation_);
+    }
+#else
+    --pending_;
+    if (failed_ == nullptr && child.promise().has_exception()) {
+      failed_ = &child;
+    }
+    // Not resumed yet, and not before await_suspend().
+    if (continuation_ != nullptr && await_ready()) {
+      get_event_loop().set_handle_will_be_called_soon(
+          *std::exchange(continuation_, nullptr));
+    }
+#endif
+  }
+
+  Children children_;
+#ifdef USE_WORK_STEALING
+  std::atomic<size_t> pending_;
+#else
+  size_t pending_;
+  typename Children::Slot* failed_ = nullptr;
+#endif
+  CoHandleManager* continuation_ = nullptr;
+};
+
+// Makes the awaiter in operator co_await, which returns it as a prvalue: it
+// can't be moved once the children point to it, and co_await of an lvalue
+// copies it with GCC 12.
+template <typename R, typename Tasks>
+struct RangeGatherAwaiterRepository {
+  auto operator co_await() && { return RangeGatherAwaiter<R>{tasks_}; }
+
+  Tasks& tasks_;
+};
+
+// A coroutine, as gather() of awaitables, so that it can be awaited later or
+// by wait_for(), and destroying it destroys the children.
+template <typename R, typename Tasks>
+auto gather_range(ResumeAtInitialSuspend, Tasks tasks)
+    -> Task<std::vector<GetTypeIfVoid_t<R>>> {
+  co_return co_await RangeGatherAwaiterRepository<R, Tasks>{tasks};
+}
+
 }  // namespace detail
 
 template <concepts::Awaitable... Futs>
@@ -129,4 +318,16 @@ template <concepts::Awaitable... Futs>
   return detail::gather(resume_at_initial_suspend, std::forward<Futs>(futs)...);
 }
 
+// Run a range of tasks concurrently, e.g. a std::vector<Task<T>> or a view
+// making them, and return their results as a std::vector<T>. The tasks are
+// moved out of the range, so it is passed as an rvalue.
+template <std::ranges::forward_range Tasks,
+          typename R = typename detail::TaskResult<
+              std::ranges::range_value_t<Tasks>>::type>
+  requires(!std::is_lvalue_reference_v<Tasks>)
+[[nodiscard("discard gather doesn't make sense")]] auto gather(Tasks&& tasks) {
+  return detail::gather_range<R>(resume_at_initial_suspend,
+                                 std::forward<Tasks>(tasks));
+}
+
 }  // namespace asyncio
@@ -1,34 +1,121 @@
 #pragma once
 
+#ifdef USE_TASK_STATS
+#include <asyncio/task_stats.h>
+#endif
+#include <asyncio/timer/timer_entry.h>
+
 // 3rd
 #include <fmt/core.h>
 
 // std
+#include <atomic>
 #include <cstdint>
+#include <iostream>
 #include <source_location>
 #include <string>
 
 namespace asyncio {
 
+class EventLoop;
+
 using HandleId = uint64_t;
 
+// Which ready handles an EventLoop runs first, see run_ready_tasks().
+enum class Priority : uint8_t { HIGH, NORMAL /* default */, BACKGROUND };
+inline constexpr size_t kPriorities = 3;
+
+namespace detail {
+
+// Of the handle the event loop of this thread is running. The handles created
+// meanwhile, e.g. the tasks created by a task, have the same priority.
+inline thread_local Priority running_priority = Priority::NORMAL;
+
+#ifdef USE_SYMMETRIC_TRANSFER
+// Tasks resumed directly by co_await or by a finishing child since the event
+// loop of this thread last ran a handle. Unless the compiler turns them into
+// tail calls (GCC doesn't at -O0), each one is a nested call, so past
+// kMaxSymmetricTransfers the next one goes through the ready queue, which
+// unwinds the stack.
+inline thread_local size_t symmetric_transfers = 0;
+inline constexpr size_t kMaxSymmetricTransfers = 64;
+
+inline bool try_symmetric_transfer() noexcept {
+  if (symmetric_transfers < kMaxSymmetricTransfers) [[likely]] {
+    ++symmetric_transfers;
+    return true;
+  }
+  symmetric_transfers = 0;
+  return false;
+}
+#endif
+
+}  // namespace detail
+
 class HandleIdAndState {
  public:
   enum class State : uint8_t { UNSCHEDULED /* default */, SUSPEND, SCHEDULED };
 
-  HandleIdAndState() noexcept : handle_id_(handle_id_generation_++) {}
+  HandleIdAndState() noexcept
+      : handle_id_(next_handle_id()),
+        timer_entry_(this),
+        priority_(detail::running_priority) {}
 
   virtual void run() = 0;
 
   void set_state(State state) { state_ = state; }
 
+  State get_state() const { return state_; }
+
   HandleId get_handle_id() const { return handle_id_; }
 
-  virtual ~HandleIdAndState() = default;
+  Priority priority() const { return priority_; }
+  // Not while it is in the ready queue, which is by priority.
+  void set_priority(Priority priority) { priority_ = priority; }
+
+  // Used by the timer queue of EventLoop when the handle is scheduled later.
+  TimerEntry& timer_entry() { return timer_entry_; }
+
+  // Position in the ready queue of EventLoop when the handle is scheduled soon.
+  size_t ready_index() const { return ready_index_; }
+  void set_ready_index(size_t index) { ready_index_ = index; }
+
+  // The EventLoop which scheduled the handle last. Each thread has its own, so
+  // a scheduled handle destroyed by another thread leaves the queues of this
+  // one, which mustn't be running meanwhile.
+  EventLoop* loop() const { return loop_; }
+  void set_loop(EventLoop* loop) { loop_ = loop; }
+
+#ifdef USE_TASK_STATS
+  detail::TaskClock& task_clock() { return task_clock_; }
+#endif
+
+#ifdef USE_SLOW_CALLBACK_CHECK
+  // Set by EventLoop while it runs the handle, which needs to know whether
+  // run() destroyed it.
+  void set_running(bool running) { running_ = running; }
+#endif
+
+  // Leaves the timer queue or the ready queue if it is still scheduled.
+  virtual ~HandleIdAndState();
 
  private:
+  // Unique among all threads. Each thread reserves a block of ids at a time,
+  // so creating a handle doesn't touch the shared atomic counter.
+  static HandleId next_handle_id() noexcept;
+
   HandleId handle_id_;
-  static HandleId handle_id_generation_;
+  TimerEntry timer_entry_;
+  size_t ready_index_ = 0;
+  EventLoop* loop_ = nullptr;
+#ifdef USE_SLOW_CALLBACK_CHECK
+  bool running_ = false;
+#endif
+#ifdef USE_TASK_STATS
+  detail::TaskClock task_clock_;
+#endif
+  Priority priority_;
+  static std::atomic<HandleId> handle_id_generation_;
 
  protected:
   State state_{State::UNSCHEDULED};
@@ -44,7 +131,8 @@ class CoHandleManager : public HandleIdAndState {
                        frame_info.file_name(), frame_info.line());
   }
 
-  virtual void dump_backtrace(size_t depth) const {}
+  virtual void dump_backtrace(size_t depth,
+                              std::ostream& out = std::cout) const {}
 
   void schedule();
   void set_cancelled();
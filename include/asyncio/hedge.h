@@ -0,0 +1,231 @@
+#pragma once
+
+#include <asyncio/child_tasks.h>
+#include <asyncio/event_loop.h>
+#include <asyncio/handle.h>
+#include <asyncio/task.h>
+#include <asyncio/utils/histogram.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace asyncio {
+
+// Latencies of the attempts which answered hedged requests, to hedge after a
+// percentile of them. The delay is the initial one until window attempts are
+// recorded, then the percentile of the last window, so it follows the
+// backend as it gets slower or faster.
+class HedgeLatency : private NonCopyable {
+ public:
+  explicit HedgeLatency(
+      std::chrono::nanoseconds initial_delay, double percentile = 95,
+      size_t window = 1000)
+      : delay_(initial_delay), percentile_(percentile), window_(window) {}
+
+  void record(std::chrono::nanoseconds latency) {
+    histogram_.record(static_cast<uint64_t>(std::max<int64_t>(
+        latency.count(), 0)));
+    if (++in_window_ == window_) {
+      update_delay();
+    }
+  }
+
+  // After how long to start another attempt.
+  std::chrono::nanoseconds delay() const { return delay_; }
+
+  // The latencies recorded so far.
+  HistogramSnapshot snapshot() const { return histogram_.snapshot(); }
+
+ private:
+  void update_delay() {
+    auto all = histogram_.snapshot();
+    // The window is what was recorded since the last one.
+    HistogramSnapshot window = all;
+    if (!window_start_.counts.empty()) {
+      for (size_t i = 0; i < window.counts.size(); ++i) {
+        window.counts[i] -= window_start_.counts[i];
+      }
+      window.count -= window_start_.count;
+      window.sum -= window_start_.sum;
+    }
+    delay_ = std::chrono::nanoseconds(window.percentile(percentile_));
+    window_start_ = std::move(all);
+    in_window_ = 0;
+  }
+
+  Histogram histogram_;
+  HistogramSnapshot window_start_;
+  std::chrono::nanoseconds delay_;
+  double percentile_;
+  size_t window_;
+  size_t in_window_ = 0;
+};
+
+namespace detail {
+
+// Starts an attempt, and another one each time delay passes without an
+// answer, or at once when one fails, up to max_attempts. Done with the first
+// answer, or the last failure when all of them have failed.
+template <typename R, typename MakeRequest>
+class HedgeAwaiter : NonCopyable {
+  using Children = ChildTasks<R, HedgeAwaiter>;
+  friend Children;
+  using Slot = typename Children::Slot;
+
+  struct Timer final : HandleIdAndState {
+    void run() final { hedge->timer_fired(); }
+
+    HedgeAwaiter* hedge = nullptr;
+  };
+
+ public:
+  HedgeAwaiter(MakeRequest& make_request, std::chrono::nanoseconds delay,
+               HedgeLatency* latency, size_t max_attempts)
+      : make_request_(make_request),
+        delay_(latency != nullptr ? latency->delay() : delay),
+        latency_(latency),
+        attempts_(*this, std::max<size_t>(max_attempts, 1)),
+        started_at_(std::max<size_t>(max_attempts, 1)),
+        max_attempts_(std::max<size_t>(max_attempts, 1)) {
+    timer_.hedge = this;
+    attempt();
+  }
+
+  // The attempts and the timer point to it.
+  HedgeAwaiter(HedgeAwaiter&&) = delete;
+
+  bool await_ready() const noexcept { return done(); }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> caller) noexcept {
+    caller_ = &caller.promise();
+    caller_->set_state(HandleIdAndState::State::SUSPEND);
+  }
+
+  R await_resume() {
+    // The slower attempts and the timer are cancelled with the awaiter.
+    auto& answer = winner_ != nullptr ? *winner_ : *failed_;
+    return std::move(*answer.task).get_result();
+  }
+
+ private:
+  bool done() const {
+    return winner_ != nullptr || (running_ == 0 && failed_ != nullptr);
+  }
+
+  void attempt() {
+    started_at_[attempts_.size()] = std::chrono::steady_clock::now();
+    ++running_;
+    attempts_.add(std::invoke(make_request_));
+    if (!done() && attempts_.size() < max_attempts_) {
+      get_event_loop().call_later(delay_, timer_);
+    }
+  }
+
+  void timer_fired() {
+    if (!done() && attempts_.size() < max_attempts_) {
+      attempt();
+    }
+  }
+
+  void child_finished(Slot& child) {
+    if (done()) {
+      return;
+    }
+    --running_;
+    if (child.promise().has_exception()) {
+      failed_ = &child;
+      // Don't wait for the timer to try again.
+      if (attempts_.size() < max_attempts_) {
+        get_event_loop().set_handle_cancelled(timer_);
+        attempt();
+      }
+    } else {
+      winner_ = &child;
+      if (latency_ != nullptr) {
+        latency_->record(std::chrono::steady_clock::now() -
+                         started_at_[child.index]);
+      }
+    }
+    if (done() && caller_ != nullptr) {
+      get_event_loop().set_handle_will_be_called_soon(
+          *std::exchange(caller_, nullptr));
+    }
+  }
+
+  MakeRequest& make_request_;
+  std::chrono::nanoseconds delay_;
+  HedgeLatency* latency_;
+  Children attempts_;
+  std::vector<std::chrono::steady_clock::time_point> started_at_;
+  size_t max_attempts_;
+  size_t running_ = 0;
+  Slot* winner_ = nullptr;
+  Slot* failed_ = nullptr;
+  CoHandleManager* caller_ = nullptr;
+  // Last, so that it leaves the timer queue before the rest is destroyed.
+  Timer timer_;
+};
+
+// Makes the awaiter in operator co_await, as RangeGatherAwaiterRepository.
+template <typename R, typename MakeRequest>
+struct HedgeAwaiterRepository {
+  auto operator co_await() && {
+    return HedgeAwaiter<R, MakeRequest>{make_request_, delay_, latency_,
+                                        max_attempts_};
+  }
+
+  MakeRequest& make_request_;
+  std::chrono::nanoseconds delay_;
+  HedgeLatency* latency_;
+  size_t max_attempts_;
+};
+
+template <typename R, typename MakeRequest>
+Task<R> hedge(MakeRequest make_request, std::chrono::nanoseconds delay,
+              HedgeLatency* latency, size_t max_attempts) {
+  co_return co_await HedgeAwaiterRepository<R, MakeRequest>{
+      make_request, delay, latency, max_attempts};
+}
+
+template <typename MakeRequest>
+using HedgeResult =
+    typename TaskResult<std::invoke_result_t<MakeRequest&>>::type;
+
+}  // namespace detail
+
+// Send a request with make_request(), which returns a Task, and send it again
+// each time delay passes without an answer (or at once when an attempt
+// throws), up to max_attempts in flight. Return the first answer and cancel
+// the other attempts, or rethrow the exception of the last one if all of them
+// fail. The attempts must be safe to repeat.
+template <typename MakeRequest,
+          typename R = detail::HedgeResult<std::decay_t<MakeRequest>>>
+[[nodiscard("should use co_await")]] Task<R> hedge(
+    MakeRequest&& make_request, std::chrono::nanoseconds delay,
+    size_t max_attempts = 2) {
+  return detail::hedge<R>(std::forward<MakeRequest>(make_request), delay,
+                          nullptr, max_attempts);
+}
+
+// The same, after latency.delay(), and record the latency of the attempt
+// which answers into it.
+template <typename MakeRequest,
+          typename R = detail::HedgeResult<std::decay_t<MakeRequest>>>
+[[nodiscard("should use co_await")]] Task<R> hedge(MakeRequest&& make_request,
+                                                   HedgeLatency& latency,
+                                                   size_t max_attempts = 2) {
+  return detail::hedge<R>(std::forward<MakeRequest>(make_request),
+                          std::chrono::nanoseconds{}, &latency, max_attempts);
+}
+
+}  // namespace asyncio
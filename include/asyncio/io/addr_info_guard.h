@@ -1,5 +1,8 @@
 #pragma once
 
+// std
+#include <memory>
+
 // sys
 #include <netdb.h>
 
@@ -14,4 +17,12 @@ struct AddrInfoGuard {
   addrinfo* info_ = nullptr;
 };
 
+struct AddrInfoDeleter {
+  void operator()(addrinfo* info) const { freeaddrinfo(info); }
+};
+
+// Owns the result of getaddrinfo() like AddrInfoGuard, but can be moved, e.g.
+// out of the thread which resolved it.
+using AddrInfoPtr = std::unique_ptr<addrinfo, AddrInfoDeleter>;
+
 }  // namespace asyncio
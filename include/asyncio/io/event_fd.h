@@ -0,0 +1,54 @@
+#pragma once
+
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+// sys
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace asyncio {
+
+// RAII for an eventfd, used by the selectors to be woken up by other threads.
+class EventFd : private NonCopyable {
+ public:
+  EventFd() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    /// https://man7.org/linux/man-pages/man2/eventfd.2.html
+    /// eventfd() creates an "eventfd object" that can be used as an event
+    /// wait/notify mechanism by user-space applications, and by the kernel to
+    /// notify user-space applications of events.  The object contains an
+    /// unsigned 64-bit integer counter that is maintained by the kernel.
+    if (fd_ < 0) {
+      throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
+  }
+
+  ~EventFd() { close(fd_); }
+
+  int fd() const { return fd_; }
+
+  // Can be called from any thread.
+  void notify() const {
+    /// A write(2) call adds the 8-byte integer value supplied in its buffer to
+    /// the counter.
+    uint64_t one = 1;
+    [[maybe_unused]] auto n = ::write(fd_, &one, sizeof one);
+  }
+
+  // Reset the counter, so that the fd isn't readable until notified again.
+  void drain() const {
+    /// If the eventfd counter has a nonzero value, then a read(2) returns 8
+    /// bytes containing that value, and the counter's value is reset to zero.
+    uint64_t value;
+    [[maybe_unused]] auto n = ::read(fd_, &value, sizeof value);
+  }
+
+ private:
+  int fd_;
+};
+
+}  // namespace asyncio
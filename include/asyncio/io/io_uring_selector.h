@@ -0,0 +1,401 @@
+#pragma once
+
+#include <asyncio/handle.h>
+#include <asyncio/io/event_fd.h>
+#include <asyncio/io/io_event.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// sys
+// https://man7.org/linux/man-pages/man7/io_uring.7.html
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace asyncio {
+
+// One request submitted to the ring. Its address is the sqe's user_data, so it
+// must stay alive (and unmoved) until the completion is reaped or cancel()
+// returns.
+struct IoUringOp {
+  HandleInfo handle_info;
+  int32_t result = 0;  // same as the syscall's return value, or -errno
+  bool pending = false;
+};
+
+// Completion-based selector. Instead of asking "which fd is ready" and then
+// doing the syscall, the operation itself (read, write, accept, connect or a
+// poll) is queued in the submission ring. Queued operations are submitted in
+// the same io_uring_enter() that waits for completions, so one syscall both
+// submits and waits.
+class IoUringSelector : private NonCopyable {
+ public:
+  // The ring needs no per-fd registration, operations carry the fd. This only
+  // keeps the same interface as EpollSelector::Registration.
+  class Registration : private NonCopyable {
+   public:
+    Registration(IoUringSelector&, int fd) : fd_(fd) {}
+    Registration(Registration&& other) noexcept
+        : fd_(std::exchange(other.fd_, -1)) {}
+
+    int fd() const { return fd_; }
+
+    void reset() {}
+
+   private:
+    int fd_;
+  };
+
+  constexpr static size_t kDefaultMaxEvents = 1024;
+
+  explicit IoUringSelector(unsigned entries = kDefaultEntries) {
+    /// https://man7.org/linux/man-pages/man2/io_uring_setup.2.html
+    /// The io_uring_setup() system call sets up a submission queue (SQ) and
+    /// completion queue (CQ) with at least entries entries, and returns a
+    /// file descriptor which can be used to perform subsequent operations on
+    /// the io_uring instance.
+    io_uring_params params{};
+    ring_fd_ =
+        static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd_ < 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "io_uring_setup");
+    }
+    // Timeout of io_uring_enter() needs IORING_ENTER_EXT_ARG (Linux 5.11).
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+      release();
+      throw std::system_error(ENOSYS, std::generic_category(),
+                              "io_uring_enter with IORING_ENTER_EXT_ARG");
+    }
+
+    sq_ring_size_ =
+        params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      // SQ ring and CQ ring share one mapping.
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = (params.features & IORING_FEAT_SINGLE_MMAP)
+                   ? sq_ring_
+                   : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+    if (sq_ring_ == nullptr || cq_ring_ == nullptr || sqes_ == nullptr) {
+      int err = errno;
+      release();
+      throw std::system_error(err, std::generic_category(), "mmap io_uring");
+    }
+
+    auto* sq = static_cast<char*>(sq_ring_);
+    sq_khead_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+    sq_ktail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    auto* sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    // sqes_[i] always goes into slot i, so the index array is fixed.
+    for (uint32_t i = 0; i < sq_entries_; ++i) {
+      sq_array[i] = i;
+    }
+    sq_tail_ = *sq_ktail_;
+
+    auto* cq = static_cast<char*>(cq_ring_);
+    cq_khead_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cq_ktail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  }
+
+  ~IoUringSelector() { release(); }
+
+  // Submit the queued operations, wait at most timeout_ms for completions
+  // (-1: infinitely, 0: don't wait) and call on_ready(HandleIdAndState&) for
+  // each finished one. At most max_events() completions are reaped per call,
+  // the others stay in the completion ring until the next one.
+  template <typename F>
+  void select(int timeout_ms, F&& on_ready) {
+    errno = 0;
+    if (!completed_.empty()) {
+      // Some completions were reaped by cancel(), don't block.
+      timeout_ms = 0;
+    }
+    if (!waker_armed_) {
+      arm_waker();
+    }
+    if (cq_ready() == 0 || sq_ready() != 0) {
+      enter(cq_ready() == 0 ? timeout_ms : 0);
+    }
+    for (auto& event : completed_) {
+      on_ready(*event.handle_info.handle);
+    }
+    completed_.clear();
+    reap([&on_ready](const HandleInfo& info) { on_ready(*info.handle); },
+         max_events_);
+  }
+
+  size_t max_events() const { return max_events_; }
+
+  void set_max_events(size_t max_events) {
+    max_events_ = std::max<size_t>(max_events, 1);
+  }
+
+  // No operation is in flight.
+  bool is_stop() const { return pending_count_ == 0; }
+
+  // Operations in flight, each has a coroutine waiting for it.
+  size_t waiting_count() const { return pending_count_; }
+
+  // The ring keeps no fd between operations.
+  size_t registered_count() const { return 0; }
+
+  // Make a select() which is blocking, or the next one, return. Can be called
+  // from any thread.
+  void notify() const { waker_.notify(); }
+
+  // IORING_OP_POLL_ADD: one-shot readiness of fd, used by wait_io_event().
+  // POLLIN/POLLOUT have the same values as EPOLLIN/EPOLLOUT.
+  void prep_poll(IoUringOp& op, int fd, uint32_t event_type) {
+    auto& sqe = prepare(op, IORING_OP_POLL_ADD, fd);
+    sqe.poll32_events = event_type;
+  }
+
+  void prep_read(IoUringOp& op, int fd, void* buf, size_t len) {
+    auto& sqe = prepare(op, IORING_OP_READ, fd);
+    sqe.addr = reinterpret_cast<uint64_t>(buf);
+    sqe.len = static_cast<uint32_t>(len);
+    sqe.off = static_cast<uint64_t>(-1);  // current position (or a socket)
+  }
+
+  void prep_write(IoUringOp& op, int fd, const void* buf, size_t len) {
+    auto& sqe = prepare(op, IORING_OP_WRITE, fd);
+    sqe.addr = reinterpret_cast<uint64_t>(buf);
+    sqe.len = static_cast<uint32_t>(len);
+    sqe.off = static_cast<uint64_t>(-1);
+  }
+
+  void prep_accept(IoUringOp& op, int fd, sockaddr* addr, socklen_t* len,
+                   int flags = 0) {
+    auto& sqe = prepare(op, IORING_OP_ACCEPT, fd);
+    sqe.addr = reinterpret_cast<uint64_t>(addr);
+    sqe.addr2 = reinterpret_cast<uint64_t>(len);
+    sqe.accept_flags = flags;
+  }
+
+  void prep_connect(IoUringOp& op, int fd, const sockaddr* addr,
+                    socklen_t len) {
+    auto& sqe = prepare(op, IORING_OP_CONNECT, fd);
+    sqe.addr = reinterpret_cast<uint64_t>(addr);
+    sqe.off = len;
+  }
+
+  // Cancel an in-flight operation and wait until the kernel releases it, so
+  // that op and its buffers can be destroyed safely after returning. Other
+  // completions reaped meanwhile are kept for the next select().
+  void cancel(IoUringOp& op) {
+    // The coroutine is going away, never report this operation.
+    op.handle_info.handle = nullptr;
+    if (!op.pending) {
+      std::erase_if(completed_, [&op](const IoEvent& event) {
+        return event.handle_info.id == op.handle_info.id;
+      });
+      return;
+    }
+    auto& sqe = next_sqe();
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.addr = reinterpret_cast<uint64_t>(&op);
+    sqe.user_data = kInternalUserData;
+    commit_sqe();
+    while (op.pending) {
+      enter(-1);
+      reap([this](const HandleInfo& info) {
+        completed_.push_back(
+            IoEvent{.fd = -1, .event_type = 0, .handle_info = info});
+      });
+    }
+  }
+
+ private:
+  // Map a region of the ring shared with the kernel. Return nullptr if failed.
+  void* map(size_t size, uint64_t offset) const {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd_, (off_t)offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  void release() {
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    sqes_ = nullptr;
+    cq_ring_ = sq_ring_ = nullptr;
+    if (ring_fd_ >= 0) {
+      close(ring_fd_);
+    }
+    ring_fd_ = -1;
+  }
+
+  io_uring_sqe& prepare(IoUringOp& op, uint8_t opcode, int fd) {
+    auto& sqe = next_sqe();
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.user_data = reinterpret_cast<uint64_t>(&op);
+    op.pending = true;
+    ++pending_count_;
+    // The sqe is filled by the caller; the kernel only reads it in enter().
+    commit_sqe();
+    return sqe;
+  }
+
+  // Keep a read of the waker in flight. Like a cancel request, it isn't in
+  // pending_count_, so it doesn't keep the event loop running.
+  void arm_waker() {
+    auto& sqe = next_sqe();
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = waker_.fd();
+    sqe.addr = reinterpret_cast<uint64_t>(&waker_value_);
+    sqe.len = sizeof waker_value_;
+    sqe.user_data = kWakerUserData;
+    commit_sqe();
+    waker_armed_ = true;
+  }
+
+  io_uring_sqe& next_sqe() {
+    if (sq_ready() == sq_entries_) {
+      // Submission queue is full, hand them to the kernel first.
+      enter(0);
+    }
+    auto& sqe = sqes_[sq_tail_ & sq_mask_];
+    std::memset(&sqe, 0, sizeof sqe);
+    return sqe;
+  }
+
+  void commit_sqe() {
+    ++sq_tail_;
+    std::atomic_ref(*sq_ktail_).store(sq_tail_, std::memory_order_release);
+  }
+
+  // Number of sqes not consumed by the kernel yet.
+  uint32_t sq_ready() const {
+    return sq_tail_ -
+           std::atomic_ref(*sq_khead_).load(std::memory_order_acquire);
+  }
+
+  // Number of cqes not reaped yet.
+  uint32_t cq_ready() const {
+    return std::atomic_ref(*cq_ktail_).load(std::memory_order_acquire) -
+           *cq_khead_;
+  }
+
+  void enter(int timeout_ms) {
+    /// https://man7.org/linux/man-pages/man2/io_uring_enter.2.html
+    /// io_uring_enter() is used to initiate and complete I/O using the shared
+    /// submission and completion queues. A single call can both submit new
+    /// I/O and wait for completions of I/O initiated by this call or previous
+    /// calls to io_uring_enter().
+    uint32_t to_submit = sq_ready();
+    uint32_t min_complete = 0;
+    uint32_t flags = 0;
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    if (timeout_ms != 0) {
+      min_complete = 1;
+      flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+      if (timeout_ms > 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+      }
+    }
+    if (to_submit == 0 && min_complete == 0) {
+      return;
+    }
+    // ETIME (timeout) and EINTR (signal) just mean nothing is completed.
+    syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags,
+            (flags & IORING_ENTER_EXT_ARG) ? &arg : nullptr, sizeof arg);
+  }
+
+  // Call on_completed(const HandleInfo&) for at most limit completions whose
+  // coroutine is still waiting.
+  template <typename F>
+  void reap(F&& on_completed, size_t limit = SIZE_MAX) {
+    uint32_t head = *cq_khead_;
+    uint32_t tail = std::atomic_ref(*cq_ktail_).load(std::memory_order_acquire);
+    if (tail - head > limit) {
+      tail = head + static_cast<uint32_t>(limit);
+    }
+    for (; head != tail; ++head) {
+      const auto& cqe = cqes_[head & cq_mask_];
+      if (cqe.user_data == kInternalUserData) {
+        continue;
+      }
+      if (cqe.user_data == kWakerUserData) {
+        // Read the counter of the waker, select() reads it again.
+        waker_armed_ = false;
+        continue;
+      }
+      auto* op = reinterpret_cast<IoUringOp*>(cqe.user_data);
+      op->result = cqe.res;
+      op->pending = false;
+      --pending_count_;
+      if (op->handle_info.handle != nullptr) {
+        on_completed(op->handle_info);
+      }
+    }
+    std::atomic_ref(*cq_khead_).store(head, std::memory_order_release);
+  }
+
+ private:
+  constexpr static unsigned kDefaultEntries = 256;
+  // user_data of requests which have no IoUringOp (cancel requests).
+  constexpr static uint64_t kInternalUserData = 0;
+  // user_data of the read of the waker. An IoUringOp is never at address 1.
+  constexpr static uint64_t kWakerUserData = 1;
+
+  int ring_fd_ = -1;
+
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  uint32_t* sq_khead_ = nullptr;
+  uint32_t* sq_ktail_ = nullptr;
+  uint32_t sq_mask_ = 0;
+  uint32_t sq_entries_ = 0;
+  uint32_t sq_tail_ = 0;  // local tail, published by commit_sqe()
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  uint32_t* cq_khead_ = nullptr;
+  uint32_t* cq_ktail_ = nullptr;
+  uint32_t cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  size_t pending_count_ = 0;
+  EventFd waker_;
+  bool waker_armed_ = false;
+  uint64_t waker_value_ = 0;
+  size_t max_events_ = kDefaultMaxEvents;
+  // Completions reaped by cancel(), reported by the next select().
+  std::vector<IoEvent> completed_;
+};
+
+}  // namespace asyncio
@@ -1,10 +1,19 @@
 #pragma once
 
 #include <asyncio/handle.h>
+#include <asyncio/io/event_fd.h>
 #include <asyncio/io/io_event.h>
+#include <asyncio/utils/non_copyable.h>
+
+#ifdef USE_IO_URING
+#include <asyncio/io/io_uring_selector.h>
+#endif
 
 // std
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 // sys
@@ -14,9 +23,63 @@
 
 namespace asyncio {
 
-class Selector {
+class EpollSelector {
  public:
-  Selector() : epfd_(epoll_create1(0)) {
+  // Keeps an fd in the interest list, edge-triggered for both directions, from
+  // the first time it's waited for until reset() or destruction. So waiting on
+  // it again costs no epoll_ctl() at all. The callers try the syscall first,
+  // and only wait after EAGAIN, as edge-triggered mode requires.
+  class Registration : private NonCopyable {
+   public:
+    Registration(EpollSelector& selector, int fd)
+        : selector_(&selector), fd_(fd) {}
+
+    Registration(Registration&& other) noexcept
+        : selector_(other.selector_),
+          fd_(std::exchange(other.fd_, -1)),
+          registered_(std::exchange(other.registered_, false)),
+          reader_(std::exchange(other.reader_, {})),
+          writer_(std::exchange(other.writer_, {})) {
+      if (registered_) {
+        // epoll_event.data points to the registration, so update it.
+        selector_->modify(*this);
+      }
+    }
+
+    ~Registration() { reset(); }
+
+    int fd() const { return fd_; }
+
+    // Remove the fd from the interest list. Call it before closing the fd.
+    void reset() {
+      if (registered_) {
+        selector_->remove(*this);
+      }
+    }
+
+    void wait(uint32_t event_type, const HandleInfo& handle_info) {
+      selector_->wait(*this, event_type, handle_info);
+    }
+
+    void cancel_wait(uint32_t event_type, HandleId id) {
+      selector_->cancel_wait(*this, event_type, id);
+    }
+
+   private:
+    friend class EpollSelector;
+
+    EpollSelector* selector_;
+    int fd_;
+    bool registered_ = false;
+    // handle is nullptr if no coroutine is waiting.
+    HandleInfo reader_{};
+    HandleInfo writer_{};
+  };
+
+  constexpr static size_t kDefaultMaxEvents = 1024;
+
+  explicit EpollSelector(size_t max_events = kDefaultMaxEvents)
+      : epfd_(epoll_create1(0)), events_(std::max<size_t>(max_events, 1)) {
     /// epoll_create(2) creates a new epoll instance and returns a file
     /// descriptor referring to that instance.  (The more recent
     /// epoll_create1(2) extends the functionality of epoll_create(2).)
@@ -24,9 +87,18 @@ class Selector {
       perror("epoll_create1");
       throw;
     }
+    // Level-triggered, it stays ready until select() drains it. It is no
+    // waiting coroutine, so it doesn't keep the event loop running.
+    epoll_event ev{.events = EPOLLIN, .data{.ptr = nullptr}};
+    epoll_ctl(epfd_, EPOLL_CTL_ADD, waker_.fd(), &ev);
   }
 
-  std::vector<IoEvent> select(int timeout_ms) const {
+  // Wait at most timeout_ms (-1: infinitely, 0: don't wait) for IO events,
+  // and call on_ready(HandleIdAndState&) for each coroutine woken up. At most
+  // max_events() fds are reported per call, the others stay in the ready list
+  // of the epoll instance until the next one.
+  template <typename F>
+  void select(int timeout_ms, F&& on_ready) {
     /// https://man7.org/linux/man-pages/man3/errno.3.html
     /// Set by system calls and some library functions in the event of an error
     /// to indicate what went wrong.
@@ -43,7 +115,6 @@ class Selector {
     ///   uint32_t     events;    /* Epoll events */
     ///   epoll_data_t data;      /* User data variable */
     /// };
-    std::vector<epoll_event> epoll_events(register_event_count_);
 
     /// epoll_wait(2) waits for I/O events, blocking the calling thread if no
     /// events are currently available.  (This system call can be thought of as
@@ -62,33 +133,61 @@ class Selector {
     /// for the requested I/O, or zero if no file descriptor became ready during
     /// the requested timeout milliseconds.  On failure, epoll_wait() returns -1
     /// and errno is set to indicate the error.
-    int num_fd = epoll_wait(epfd_, epoll_events.data(), register_event_count_,
-                            timeout_ms);
-    std::vector<IoEvent> ready_io_events;
-    for (size_t i = 0; i < num_fd; ++i) {
+    int num_fd = epoll_wait(epfd_, events_.data(),
+                            static_cast<int>(events_.size()), timeout_ms);
+    for (int i = 0; i < num_fd; ++i) {
+      auto data = reinterpret_cast<uintptr_t>(events_[i].data.ptr);
+      if (data == 0) {
+        // Woken up by notify().
+        waker_.drain();
+        continue;
+      }
+      if (data & kRegistrationTag) {
+        auto* registration =
+            reinterpret_cast<Registration*>(data & ~kRegistrationTag);
+        uint32_t events = events_[i].events;
+        // Errors and hang-ups wake both sides, the syscall will report them.
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+          wake_up(registration->reader_, on_ready);
+        }
+        if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+          wake_up(registration->writer_, on_ready);
+        }
+        continue;
+      }
       // struct HandleInfo {
       //   HandleId id;
       //   HandleIdAndState* handle;
       // };
-      // struct IoEvent {
-      //    int fd;
-      //    uint32_t event_type;
-      //    HandleInfo handle_info;
-      //  };
-      ready_io_events.emplace_back(
-          IoEvent{.handle_info = *reinterpret_cast<HandleInfo*>(
-                      epoll_events[i].data.ptr /* void* */)});
+      // register_event() stores &IoEvent::handle_info in epoll_event.data.
+      on_ready(*reinterpret_cast<HandleInfo*>(events_[i].data.ptr)->handle);
     }
-    return ready_io_events;
   }
 
-  ~Selector() {
+  size_t max_events() const { return events_.size(); }
+
+  // The event buffer is allocated here once, not in every select().
+  void set_max_events(size_t max_events) {
+    events_.assign(std::max<size_t>(max_events, 1), epoll_event{});
+  }
+
+  ~EpollSelector() {
     if (epfd_ > 0) {
       close(epfd_);
     }
   }
 
-  bool is_stop() const { return register_event_count_ == 1; }
+  // No coroutine is waiting for an fd. Registered but idle fds don't count.
+  bool is_stop() const { return waiting_count_ == 0; }
+
+  size_t waiting_count() const { return waiting_count_; }
+
+  // Fds in the interest list, with or without a waiting coroutine.
+  size_t registered_count() const { return registered_count_; }
+
+  // Make a select() which is blocking, or the next one, return. Can be called
+  // from any thread.
+  void notify() const { waker_.notify(); }
 
   void register_event(const IoEvent& event) {
     // https://en.cppreference.com/w/cpp/language/const_cast
@@ -98,20 +197,103 @@ class Selector {
     /// epoll_ctl(2), which adds items to the interest list of the epoll
     /// instance.
     if (epoll_ctl(epfd_, EPOLL_CTL_ADD, event.fd, &ev) == 0) {
-      ++register_event_count_;
+      ++waiting_count_;
+      ++registered_count_;
     }
   }
 
   void remove_event(const IoEvent& event) {
     epoll_event ev{.events = event.event_type};
     if (epoll_ctl(epfd_, EPOLL_CTL_DEL, event.fd, &ev) == 0) {
-      --register_event_count_;
+      --waiting_count_;
+      --registered_count_;
+    }
+  }
+
+ private:
+  // Registration* is tagged in epoll_event.data to tell it from HandleInfo*.
+  constexpr static uintptr_t kRegistrationTag = 1;
+
+  epoll_event registration_event(Registration& registration) const {
+    /// EPOLLET: Requests edge-triggered notification.
+    /// EPOLLRDHUP: Stream socket peer closed connection, or shut down writing
+    /// half of connection.
+    return {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+            .data{.ptr = reinterpret_cast<void*>(
+                      reinterpret_cast<uintptr_t>(&registration) |
+                      kRegistrationTag)}};
+  }
+
+  void wait(Registration& registration, uint32_t event_type,
+            const HandleInfo& handle_info) {
+    if (!registration.registered_) {
+      auto ev = registration_event(registration);
+      if (epoll_ctl(epfd_, EPOLL_CTL_ADD, registration.fd_, &ev) == 0) {
+        registration.registered_ = true;
+        ++registered_count_;
+      }
+    }
+    auto& waiter =
+        (event_type & EPOLLOUT) ? registration.writer_ : registration.reader_;
+    waiter = handle_info;
+    ++waiting_count_;
+  }
+
+  void cancel_wait(Registration& registration, uint32_t event_type,
+                   HandleId id) {
+    auto& waiter =
+        (event_type & EPOLLOUT) ? registration.writer_ : registration.reader_;
+    if (waiter.handle != nullptr && waiter.id == id) {
+      waiter = {};
+      --waiting_count_;
+    }
+  }
+
+  void modify(Registration& registration) {
+    auto ev = registration_event(registration);
+    epoll_ctl(epfd_, EPOLL_CTL_MOD, registration.fd_, &ev);
+  }
+
+  void remove(Registration& registration) {
+    epoll_event ev{};
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, registration.fd_, &ev);
+    registration.registered_ = false;
+    --registered_count_;
+    for (auto* waiter : {&registration.reader_, &registration.writer_}) {
+      if (waiter->handle != nullptr) {
+        *waiter = {};
+        --waiting_count_;
+      }
+    }
+  }
+
+  template <typename F>
+  void wake_up(HandleInfo& waiter, F& on_ready) {
+    if (waiter.handle != nullptr) {
+      auto* handle = waiter.handle;
+      waiter = {};
+      --waiting_count_;
+      on_ready(*handle);
     }
   }
 
  private:
   int epfd_;
-  int register_event_count_ = 1;
+  EventFd waker_;
+  // Number of coroutines waiting for an fd.
+  int waiting_count_ = 0;
+  size_t registered_count_ = 0;
+  // Filled by epoll_wait(), its size is the maxevents argument.
+  std::vector<epoll_event> events_;
 };
 
+// Selected at build time with CMake option WITH_IO_URING.
+#ifdef USE_IO_URING
+using Selector = IoUringSelector;
+#else
+using Selector = EpollSelector;
+#endif
+
+using IoRegistration = Selector::Registration;
+
 }  // namespace asyncio
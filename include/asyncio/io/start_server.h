@@ -4,12 +4,11 @@
 #include <asyncio/io/addr_info_guard.h>
 #include <asyncio/io/io_event.h>
 #include <asyncio/io/stream.h>
-#include <asyncio/scheduled_task.h>
 #include <asyncio/task.h>
+#include <asyncio/task_group.h>
 
 // std
 #include <ios>
-#include <list>
 #include <string>
 #include <string_view>
 #include <system_error>
@@ -35,47 +34,37 @@ constexpr static size_t kMaxConnectCount = 16;
 // Use start_server() to create Server.
 template <concepts::StreamHandler STREAM_HANDLER>
 struct Server : NonCopyable {
-  Server(STREAM_HANDLER cb, int fd) : stream_handler_(cb), fd_(fd) {}
+  Server(STREAM_HANDLER cb, int fd)
+      : stream_handler_(cb),
+        fd_(fd),
+        io_(get_event_loop().make_io_registration(fd)) {}
   Server(Server&& other) noexcept
       : stream_handler_(other.stream_handler_),
-        fd_(std::exchange(other.fd_, -1)) {}
+        fd_(std::exchange(other.fd_, -1)),
+        io_(std::move(other.io_)) {}
   ~Server() { close(); }
 
+  // The connections are cancelled when it is, and an exception of one of
+  // them doesn't close the others.
   Task<void> serve_forever() {
-    IoEvent epoll_in_ev{.fd = fd_, .event_type = EPOLLIN};
-    std::list<ScheduledTask<Task<>>> connected;
+    TaskGroup connected{ChildError::IGNORE};
     while (true) {
-      co_await get_event_loop().wait_io_event(epoll_in_ev);
       sockaddr_storage remote_addr{};
       socklen_t addr_len = sizeof remote_addr;
       /// https://man7.org/linux/man-pages/man2/accept.2.html
       /// accept a connection on a socket
-      int client_fd =
-          ::accept(fd_, reinterpret_cast<sockaddr*>(&remote_addr), &addr_len);
-      if (client_fd == -1) {
+      int client_fd = co_await get_event_loop().async_accept(
+          io_, reinterpret_cast<sockaddr*>(&remote_addr), &addr_len);
+      if (client_fd < 0) {
         continue;
       }
-      connected.emplace_back(create_scheduled_task(
-          stream_handler_(Stream(client_fd, remote_addr))));
-      clean_up_connected(connected);
+      connected.spawn(stream_handler_(Stream(client_fd, remote_addr)));
     }
   }
 
  private:
-  void clean_up_connected(std::list<ScheduledTask<Task<>>>& connected) {
-    if (connected.size() < 100) [[likely]] {
-      return;
-    }
-    for (auto iter = connected.begin(); iter != connected.end();) {
-      if (iter->done()) {
-        iter = connected.erase(iter);
-      } else {
-        ++iter;
-      }
-    }
-  }
-
   void close() {
+    io_.reset();
     if (fd_ > 0) {
       ::close(fd_);
     }
@@ -86,11 +75,16 @@ struct Server : NonCopyable {
   /// https://en.cppreference.com/w/cpp/language/attributes/no_unique_address
   [[no_unique_address]] STREAM_HANDLER stream_handler_;
   int fd_ = -1;
+  IoRegistration io_;
 };
 
+// If reuse_port is true, several servers (usually one per event loop thread,
+// see run_on_threads()) can listen on the same port, and the kernel spreads the
+// incoming connections among them.
 template <concepts::StreamHandler STREAM_HANDLER>
 Task<Server<STREAM_HANDLER>> start_server(STREAM_HANDLER cb,
-                                          std::string_view ip, uint16_t port) {
+                                          std::string_view ip, uint16_t port,
+                                          bool reuse_port = false) {
   /// https://man7.org/linux/man-pages/man3/getaddrinfo.3.html
   /// int getaddrinfo(const char *restrict node,
   ///                       const char *restrict service,
@@ -147,6 +141,13 @@ Task<Server<STREAM_HANDLER>> start_server(STREAM_HANDLER cb,
     /// is not possible to bind to this port for any local address.
     int yes = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+    /// SO_REUSEPORT permits multiple AF_INET or AF_INET6 sockets to be bound
+    /// to an identical socket address. For TCP sockets, this option allows
+    /// accept(2) load distribution in a multi-threaded server to be improved
+    /// by using a distinct listener socket for each thread.
+    if (reuse_port) {
+      setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof yes);
+    }
     /// https://man7.org/linux/man-pages/man2/bind.2.html
     /// When a socket is created with socket(2), it exists in a name space
     /// (address family) but has no address assigned to it.  bind() assigns the
@@ -4,18 +4,68 @@
 #include <asyncio/utils/non_copyable.h>
 
 // std
+#include <coroutine>
+#include <cstddef>
 #include <ios>
+#include <span>
 #include <system_error>
 
 // sys
+#include <fcntl.h>
 #include <sys/socket.h>
 
 namespace asyncio {
 
+namespace detail {
+
+// Forward to an IO awaiter of EventLoop, but return the number of bytes and
+// throw std::system_error for -errno, like the Task API of Stream.
+template <typename IoAwaiter>
+struct CheckedIoAwaiter {
+  bool await_ready() { return io_awaiter_.await_ready(); }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+    io_awaiter_.await_suspend(handle);
+  }
+
+  size_t await_resume() {
+    auto result = io_awaiter_.await_resume();
+    if (result < 0) {
+      throw std::system_error(
+          std::make_error_code(static_cast<std::errc>(-result)));
+    }
+    return static_cast<size_t>(result);
+  }
+
+  IoAwaiter io_awaiter_;
+};
+
+template <typename IoAwaiter>
+CheckedIoAwaiter(IoAwaiter&&) -> CheckedIoAwaiter<IoAwaiter>;
+
+// Stream tries the syscall before waiting on the fd, so a blocking fd would
+// block the whole event loop.
+inline int set_nonblocking(int fd) {
+  if (fd > 0) {
+    /// https://man7.org/linux/man-pages/man2/fcntl.2.html
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0 && !(flags & O_NONBLOCK)) {
+      fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+  }
+  return fd;
+}
+
+}  // namespace detail
+
 struct Stream : NonCopyable {
   using Buffer = std::vector<char>;
 
-  explicit Stream(int fd) : fd_(fd) {
+  // fd is made nonblocking if it isn't.
+  explicit Stream(int fd)
+      : fd_(detail::set_nonblocking(fd)),
+        io_(get_event_loop().make_io_registration(fd)) {
     if (fd_ > 0) {
       socklen_t addr_len = sizeof sock_info_;
       /// https://man7.org/linux/man-pages/man2/getsockname.2.html
@@ -33,20 +83,42 @@ struct Stream : NonCopyable {
   }
 
   Stream(int fd, const sockaddr_storage& sock_info)
-      : fd_(fd), sock_info_(sock_info) {}
+      : fd_(detail::set_nonblocking(fd)),
+        io_(get_event_loop().make_io_registration(fd)),
+        sock_info_(sock_info) {}
 
   Stream(Stream&& other) noexcept
-      : fd_{std::exchange(other.fd_, -1)}, sock_info_(other.sock_info_) {}
+      : fd_{std::exchange(other.fd_, -1)},
+        io_(std::move(other.io_)),
+        sock_info_(other.sock_info_) {}
 
   ~Stream() { close(); }
 
   void close() {
+    io_.reset();
     if (fd_ > 0) {
       ::close(fd_);
     }
     fd_ = -1;
   }
 
+  // Read at most buf.size() bytes, suspending the caller directly instead of
+  // creating a Task. Result: number of bytes read, 0 at EOF. Throws
+  // std::system_error, with EAGAIN only if another task drained the stream.
+  [[nodiscard("should use co_await")]] auto async_read_some(
+      std::span<char> buf) {
+    return detail::CheckedIoAwaiter{
+        get_event_loop().async_read(io_, buf.data(), buf.size())};
+  }
+
+  // Write at most buf.size() bytes, like async_read_some().
+  // Result: number of bytes written.
+  [[nodiscard("should use co_await")]] auto async_write_some(
+      std::span<const char> buf) {
+    return detail::CheckedIoAwaiter{
+        get_event_loop().async_write(io_, buf.data(), buf.size())};
+  }
+
   Task<Buffer> read(ssize_t sz = -1) {
     if (sz < 0) {
       // Read until EOF
@@ -56,27 +128,29 @@ struct Stream : NonCopyable {
     Buffer result(sz, 0);
     /// EPOLLIN: The associated file is available for read(2) operations.
     /// https://man7.org/linux/man-pages/man2/epoll_ctl.2.html
-    IoEvent epoll_in_ev{.fd = fd_, .event_type = EPOLLIN};
-    co_await get_event_loop().wait_io_event(epoll_in_ev);
-    sz = ::read(fd_, result.data(), result.size());
-    if (sz == -1) {
+    do {
+      sz = co_await get_event_loop().async_read(io_, result.data(),
+                                                result.size());
+    } while (sz == -EAGAIN);
+    if (sz < 0) {
       throw std::system_error(
-          std::make_error_code(static_cast<std::errc>(errno)));
+          std::make_error_code(static_cast<std::errc>(-sz)));
     }
     result.resize(sz);
     co_return result;
   }
 
   Task<> write(const Buffer& buf) {
-    IoEvent epoll_out_ev{.fd = fd_, .event_type = EPOLLOUT};
     ssize_t total_write = 0;
     while (total_write < buf.size()) {
-      co_await get_event_loop().wait_io_event(epoll_out_ev);
-      ssize_t sz =
-          ::write(fd_, buf.data() + total_write, buf.size() - total_write);
-      if (sz == -1) {
+      ssize_t sz = co_await get_event_loop().async_write(
+          io_, buf.data() + total_write, buf.size() - total_write);
+      if (sz == -EAGAIN) {
+        continue;
+      }
+      if (sz < 0) {
         throw std::system_error(
-            std::make_error_code(static_cast<std::errc>(errno)));
+            std::make_error_code(static_cast<std::errc>(-sz)));
       }
       total_write += sz;
     }
@@ -87,17 +161,18 @@ struct Stream : NonCopyable {
  private:
   Task<Buffer> read_until_eof() {
     Buffer result(kChunkSize, 0);
-    IoEvent epoll_in_ev{.fd = fd_, .event_type = EPOLLIN};
     ssize_t current_read = 0;
     int has_read = 0;
     do {
-      co_await get_event_loop().wait_io_event(epoll_in_ev);
       /// https://man7.org/linux/man-pages/man2/read.2.html
       /// Return value: -1: error, 0: EOF, positive: num of bytes read
-      current_read = ::read(fd_, result.data() + has_read, kChunkSize);
-      if (current_read == -1) {
+      do {
+        current_read = co_await get_event_loop().async_read(
+            io_, result.data() + has_read, kChunkSize);
+      } while (current_read == -EAGAIN);
+      if (current_read < 0) {
         throw std::system_error(
-            std::make_error_code(static_cast<std::errc>(errno)));
+            std::make_error_code(static_cast<std::errc>(-current_read)));
       }
       if (current_read < kChunkSize) {
         result.resize(has_read + current_read);
@@ -111,6 +186,7 @@ struct Stream : NonCopyable {
 
  private:
   int fd_ = -1;
+  IoRegistration io_;
   /// https://illumos.org/man/3SOCKET/sockaddr_storage
   /// The sockaddr_storage structure is a sockaddr that is not associated with
   /// an address family.  Instead, it is large enough to hold the contents of
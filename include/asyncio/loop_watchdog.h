@@ -0,0 +1,67 @@
+#pragma once
+
+#include <asyncio/event_loop.h>
+#include <asyncio/slow_callback.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+namespace asyncio {
+
+// A thread which looks at a loop a few times per stall_after, and reports
+// once a handle which has been running for stall_after, while it still
+// blocks the loop. The loop itself can only report it once it is done (see
+// EventLoop::set_slow_callback_duration), which may be never.
+//
+// handler is called on the thread of the watchdog, with no backtrace: the
+// frames of the coroutine are being changed by the loop. The loop reports
+// the same id with its backtrace if it finishes slower than its
+// slow_callback_duration().
+class LoopWatchdog : private NonCopyable {
+ public:
+  LoopWatchdog(EventLoop& loop, std::chrono::nanoseconds stall_after,
+               SlowCallbackHandler handler = print_slow_callback)
+      : loop_(loop),
+        stall_after_(stall_after),
+        handler_(std::move(handler)),
+        thread_([this](std::stop_token stop) { watch(stop); }) {}
+
+ private:
+  void watch(std::stop_token stop) {
+    using std::chrono::steady_clock;
+    auto interval = std::max<std::chrono::nanoseconds>(
+        stall_after_ / 4, std::chrono::microseconds(100));
+    // The start of the last stall reported, so that it is reported once.
+    steady_clock::time_point reported{};
+    std::mutex mutex;
+    std::condition_variable_any stopped;
+    std::unique_lock lock(mutex);
+    // Returns when stop is requested, or else when interval is over.
+    while (!stopped.wait_for(lock, stop, interval,
+                             [&stop] { return stop.stop_requested(); })) {
+      auto running = loop_.running_callback();
+      if (!running.has_value() || running->since == reported) {
+        continue;
+      }
+      auto duration = steady_clock::now() - running->since;
+      if (duration >= stall_after_) {
+        reported = running->since;
+        handler_({.id = running->id, .duration = duration, .finished = false});
+      }
+    }
+  }
+
+  EventLoop& loop_;
+  std::chrono::nanoseconds stall_after_;
+  SlowCallbackHandler handler_;
+  std::jthread thread_;
+};
+
+}  // namespace asyncio
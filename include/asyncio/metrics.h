@@ -0,0 +1,90 @@
+#pragma once
+
+#include <asyncio/utils/histogram.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <atomic>
+#include <cstdint>
+
+namespace asyncio {
+
+// A number written by the thread of a loop and read by any thread.
+class MetricCell {
+ public:
+  void add(uint64_t n = 1) noexcept { set(get() + n); }
+  void set(uint64_t value) noexcept {
+    value_.store(value, std::memory_order_relaxed);
+  }
+  uint64_t get() const noexcept {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+// LoopMetrics at some point.
+struct LoopMetricsSnapshot {
+  // Counts since the loop was created.
+  uint64_t iterations = 0;        // of run_once()
+  uint64_t handles_run = 0;       // from the ready queue
+  uint64_t io_events = 0;         // coroutines woken up by the selector
+  uint64_t timers_fired = 0;      // coroutines woken up by the timer queue
+  uint64_t threadsafe_calls = 0;  // callbacks from other threads
+
+  // Sizes at the end of the last iteration.
+  uint64_t ready_queue_size = 0;
+  uint64_t max_ready_queue_size = 0;  // ever
+  uint64_t timers = 0;                // in the timer queue
+  uint64_t io_waiting = 0;            // coroutines waiting for IO
+  uint64_t io_registered = 0;         // fds kept by the selector
+
+  // Time from the return of the selector to the end of the iteration, which
+  // is how long the loop doesn't look at IO or timers.
+  HistogramSnapshot iteration_ns;
+  // Number of handles taken from the ready queue in an iteration.
+  HistogramSnapshot ready_batch;
+  // How late timers fire after their deadline (the lag of the loop).
+  HistogramSnapshot timer_lag_ns;
+};
+
+// Counters, sizes and latency histograms of an EventLoop, built with
+// -DWITH_METRICS=ON. The loop updates them once per iteration, or once per
+// fired timer for timer_lag_ns. Another thread can call snapshot() at any
+// time, each number in it is consistent but they may be from different
+// iterations.
+class LoopMetrics : private NonCopyable {
+ public:
+  LoopMetricsSnapshot snapshot() const {
+    return {.iterations = iterations.get(),
+            .handles_run = handles_run.get(),
+            .io_events = io_events.get(),
+            .timers_fired = timers_fired.get(),
+            .threadsafe_calls = threadsafe_calls.get(),
+            .ready_queue_size = ready_queue_size.get(),
+            .max_ready_queue_size = max_ready_queue_size.get(),
+            .timers = timers.get(),
+            .io_waiting = io_waiting.get(),
+            .io_registered = io_registered.get(),
+            .iteration_ns = iteration_ns.snapshot(),
+            .ready_batch = ready_batch.snapshot(),
+            .timer_lag_ns = timer_lag_ns.snapshot()};
+  }
+
+  MetricCell iterations;
+  MetricCell handles_run;
+  MetricCell io_events;
+  MetricCell timers_fired;
+  MetricCell threadsafe_calls;
+  MetricCell ready_queue_size;
+  MetricCell max_ready_queue_size;
+  MetricCell timers;
+  MetricCell io_waiting;
+  MetricCell io_registered;
+  Histogram iteration_ns;
+  Histogram ready_batch;
+  Histogram timer_lag_ns;
+};
+
+}  // namespace asyncio
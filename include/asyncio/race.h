@@ -0,0 +1,150 @@
+#pragma once
+
+#include <asyncio/child_tasks.h>
+#include <asyncio/event_loop.h>
+#include <asyncio/exception.h>
+#include <asyncio/handle.h>
+#include <asyncio/task.h>
+#include <asyncio/utils/awaitable.h>
+#include <asyncio/utils/non_copyable.h>
+#include <asyncio/utils/void_value.h>
+
+// std
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace asyncio {
+
+namespace detail {
+
+// Awaits the first of a range of tasks to finish, and destroys the others.
+template <typename R>
+class RaceAwaiter : NonCopyable {
+  using Children = ChildTasks<R, RaceAwaiter>;
+  friend Children;
+  using Slot = typename Children::Slot;
+
+ public:
+  template <std::ranges::forward_range Tasks>
+  explicit RaceAwaiter(Tasks&& tasks)
+      : children_(*this, std::forward<Tasks>(tasks)) {
+    // Nothing would ever finish.
+    if (children_.size() == 0) [[unlikely]] {
+      throw NoResultError{};
+    }
+    children_.start();
+  }
+
+  // The children point to it.
+  RaceAwaiter(RaceAwaiter&&) = delete;
+
+  bool await_ready() const noexcept { return winner_ != nullptr; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> caller) noexcept {
+    caller_ = &caller.promise();
+    caller_->set_state(HandleIdAndState::State::SUSPEND);
+  }
+
+  std::pair<size_t, GetTypeIfVoid_t<R>> await_resume() {
+    // Cancel the others now: their frames are destroyed, with the timers and
+    // the waits for IO they are suspended in.
+    for (auto& child : children_) {
+      if (&child != winner_) {
+        child.task.reset();
+      }
+    }
+    if constexpr (std::is_void_v<R>) {
+      std::move(*winner_->task).get_result();
+      return {winner_->index, VoidValue{}};
+    } else {
+      return {winner_->index, std::move(*winner_->task).get_result()};
+    }
+  }
+
+ private:
+  void child_finished(Slot& child) {
+    if (winner_ != nullptr) {
+      return;
+    }
+    winner_ = &child;
+    if (caller_ != nullptr) {
+      get_event_loop().set_handle_will_be_called_soon(
+          *std::exchange(caller_, nullptr));
+    }
+  }
+
+  Children children_;
+  Slot* winner_ = nullptr;
+  CoHandleManager* caller_ = nullptr;
+};
+
+// Makes the awaiter in operator co_await, as RangeGatherAwaiterRepository.
+template <typename R, typename Tasks>
+struct RaceAwaiterRepository {
+  auto operator co_await() && { return RaceAwaiter<R>{tasks_}; }
+
+  Tasks& tasks_;
+};
+
+template <typename R, typename Tasks>
+auto race_range(ResumeAtInitialSuspend, Tasks tasks)
+    -> Task<std::pair<size_t, GetTypeIfVoid_t<R>>> {
+  co_return co_await RaceAwaiterRepository<R, Tasks>{tasks};
+}
+
+// A task for an awaitable of race(), which puts its result into the
+// alternative of its index. Fut is a reference for an lvalue.
+template <size_t Idx, typename Variant, typename Fut>
+Task<Variant> race_child(Fut fut) {
+  if constexpr (std::is_void_v<AwaitResult<Fut>>) {
+    co_await std::forward<Fut>(fut);
+    co_return Variant{std::in_place_index<Idx>};
+  } else {
+    co_return Variant{std::in_place_index<Idx>,
+                      co_await std::forward<Fut>(fut)};
+  }
+}
+
+template <size_t... Is, concepts::Awaitable... Futs>
+auto race(ResumeAtInitialSuspend, std::index_sequence<Is...>, Futs&&... futs)
+    -> Task<std::variant<GetTypeIfVoid_t<AwaitResult<Futs>>...>> {
+  using Variant = std::variant<GetTypeIfVoid_t<AwaitResult<Futs>>...>;
+  // Made while the arguments are alive, see gather().
+  std::array<Task<Variant>, sizeof...(Futs)> children{
+      race_child<Is, Variant, Futs>(std::forward<Futs>(futs))...};
+  auto [index, value] =
+      co_await RaceAwaiterRepository<Variant, decltype(children)>{children};
+  co_return std::move(value);
+}
+
+}  // namespace detail
+
+// Run awaitables concurrently until the first one finishes, and return its
+// result in a std::variant, whose index() is the index of the winner (or
+// rethrow its exception). The others are cancelled then.
+template <concepts::Awaitable... Futs>
+  requires(sizeof...(Futs) > 0)
+[[nodiscard("discard race doesn't make sense")]] auto race(Futs&&... futs) {
+  return detail::race(resume_at_initial_suspend,
+                      std::index_sequence_for<Futs...>{},
+                      std::forward<Futs>(futs)...);
+}
+
+// The same for a range of tasks known at runtime: returns the index of the
+// first one to finish and its result. The tasks are moved out of the range.
+template <std::ranges::forward_range Tasks,
+          typename R = typename detail::TaskResult<
+              std::ranges::range_value_t<Tasks>>::type>
+  requires(!std::is_lvalue_reference_v<Tasks>)
+[[nodiscard("discard race doesn't make sense")]] auto race(Tasks&& tasks) {
+  return detail::race_range<R>(resume_at_initial_suspend,
+                               std::forward<Tasks>(tasks));
+}
+
+}  // namespace asyncio
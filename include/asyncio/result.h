@@ -18,6 +18,10 @@ struct Result {
     return std::get_if<std::monostate>(&result_) == nullptr;
   }
 
+  constexpr bool has_exception() const noexcept {
+    return std::get_if<std::exception_ptr>(&result_) != nullptr;
+  }
+
   template <typename R>
   constexpr void set_value(R&& value) noexcept {
     // https://en.cppreference.com/w/cpp/utility/variant/emplace
@@ -65,6 +69,10 @@ template <>
 struct Result<void> {
   constexpr bool has_value() const noexcept { return result_.has_value(); }
 
+  constexpr bool has_exception() const noexcept {
+    return result_.has_value() && *result_ != nullptr;
+  }
+
   void return_void() noexcept { result_.emplace(nullptr); }
 
   void result() {
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <asyncio/event_loop.h>
+#include <asyncio/handle.h>
+#include <asyncio/result.h>
+#include <asyncio/thread_pool.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <coroutine>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace asyncio {
+
+namespace detail {
+
+template <typename F>
+class ExecutorAwaiter : private NonCopyable {
+  using R = std::invoke_result_t<F&>;
+
+  // Shared by the awaiter, the job and the callback back to the loop, so that
+  // the job can still finish after the awaiting coroutine is destroyed.
+  struct State {
+    explicit State(F&& fn) : fn(std::move(fn)) {}
+
+    F fn;
+    Result<R> result;
+    // Only used on the thread of the loop. nullptr if the awaiter is gone.
+    HandleIdAndState* caller = nullptr;
+  };
+
+ public:
+  ExecutorAwaiter(ThreadPool& pool, F&& fn)
+      : pool_(pool), state_(std::make_shared<State>(std::move(fn))) {}
+
+  ExecutorAwaiter(ExecutorAwaiter&&) noexcept = default;
+
+  ~ExecutorAwaiter() {
+    if (state_) {
+      state_->caller = nullptr;
+    }
+  }
+
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> caller) {
+    caller.promise().set_state(HandleIdAndState::State::SUSPEND);
+    state_->caller = &caller.promise();
+    auto& loop = get_event_loop();
+    loop.expect_threadsafe_call();
+    pool_.submit([state = state_, &loop] {
+      try {
+        if constexpr (std::is_void_v<R>) {
+          state->fn();
+          state->result.return_void();
+        } else {
+          state->result.set_value(state->fn());
+        }
+      } catch (...) {
+        state->result.unhandled_exception();
+      }
+      // Resume the caller on its own loop.
+      loop.call_soon_threadsafe([state = std::move(state), &loop] {
+        loop.threadsafe_call_received();
+        if (state->caller != nullptr) {
+          loop.set_handle_will_be_called_soon(*state->caller);
+        }
+      });
+    });
+  }
+
+  R await_resume() { return std::move(state_->result).result(); }
+
+ private:
+  ThreadPool& pool_;
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace detail
+
+// Call fn() in a thread of pool, and suspend the caller until it returns, so
+// that blocking or CPU-heavy work doesn't stall the event loop. The caller is
+// resumed on its own loop with the result, or the exception thrown by fn.
+// If the caller is destroyed meanwhile, fn still runs to its end.
+template <typename F>
+[[nodiscard("should use co_await")]] auto run_in_executor(ThreadPool& pool,
+                                                          F&& fn) {
+  return detail::ExecutorAwaiter<std::decay_t<F>>{
+      pool, std::decay_t<F>(std::forward<F>(fn))};
+}
+
+// Same as above, in the default thread pool.
+template <typename F>
+[[nodiscard("should use co_await")]] auto run_in_executor(F&& fn) {
+  return run_in_executor(get_default_executor(), std::forward<F>(fn));
+}
+
+}  // namespace asyncio
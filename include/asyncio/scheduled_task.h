@@ -1,5 +1,6 @@
 #pragma once
 
+#include <asyncio/handle.h>
 #include <asyncio/utils/future.h>
 #include <asyncio/utils/non_copyable.h>
 
@@ -13,12 +14,19 @@ template <concepts::Future TaskT>
 struct ScheduledTask : private NonCopyable {
   explicit ScheduledTask(TaskT&& task) : task_(std::forward<TaskT>(task)) {
     // Save task in task_ to avoid a temporary Task (in args) being destructed.
+    schedule();
+  }
 
-    if (task_.valid() && !task_.done()) {  // standard coroutine is valid
-      // In CoHandleManager::schedule(), because Task::promise_type inherit it.
-      // from UNSCHEDULED to SCHEDULED, send into ready queue. (Don't run it.)
-      task_.std_h_.promise().schedule();
+  ScheduledTask(TaskT&& task, Priority priority)
+      : task_(std::forward<TaskT>(task)) {
+    // Not if it is in the ready queue already (the queue is by priority), e.g.
+    // a task which started at once and yielded.
+    if (task_.valid() && !task_.done() &&
+        task_.std_h_.promise().get_state() !=
+            HandleIdAndState::State::SCHEDULED) {
+      task_.std_h_.promise().set_priority(priority);
     }
+    schedule();
   }
 
   void cancel() { task_.destroy(); }
@@ -39,12 +47,26 @@ struct ScheduledTask : private NonCopyable {
   bool done() const { return task_.done(); }
 
  private:
+  void schedule() {
+    if (task_.valid() && !task_.done()) {  // standard coroutine is valid
+      // In CoHandleManager::schedule(), because Task::promise_type inherit it.
+      // from UNSCHEDULED to SCHEDULED, send into ready queue. (Don't run it.)
+#ifdef USE_WORK_STEALING
+      task_.std_h_.promise().started_early_ = true;
+#endif
+      task_.std_h_.promise().schedule();
+    }
+  }
+
   TaskT task_;
 };
 
 template <concepts::Future Fut>
 ScheduledTask(Fut&&) -> ScheduledTask<Fut>;
 
+template <concepts::Future Fut>
+ScheduledTask(Fut&&, Priority) -> ScheduledTask<Fut>;
+
 template <concepts::Future Fut>
 [[nodiscard(
     "Discard(detached) a task will not schedule to run.")]] ScheduledTask<Fut>
@@ -52,4 +74,12 @@ create_scheduled_task(Fut&& task) {
   return ScheduledTask{std::forward<Fut>(task)};
 }
 
+// The task has the priority of the one creating it, unless it is given here.
+template <concepts::Future Fut>
+[[nodiscard(
+    "Discard(detached) a task will not schedule to run.")]] ScheduledTask<Fut>
+create_scheduled_task(Fut&& task, Priority priority) {
+  return ScheduledTask{std::forward<Fut>(task), priority};
+}
+
 }  // namespace asyncio
@@ -22,7 +22,7 @@ struct SleepAwaiter : private NonCopyable {
 
   template <typename Promise>
   void await_suspend(std::coroutine_handle<Promise> caller) const noexcept {
-    // push caller into schedule_pq_
+    // push caller into the timer queue
     get_event_loop().call_later(delay_, caller.promise());
   }
 
@@ -37,6 +37,13 @@ Task<> sleep(ResumeAtInitialSuspend, std::chrono::duration<Rep, Period> delay) {
 
 }  // namespace detail
 
+// Suspend the caller itself, without creating a Task like sleep().
+template <typename Rep, typename Period>
+[[nodiscard("should use co_await")]] auto sleep_for(
+    std::chrono::duration<Rep, Period> delay) {
+  return detail::SleepAwaiter{delay};
+}
+
 template <typename Rep, typename Period>
 [[nodiscard("should use co_await")]] Task<> sleep(
     std::chrono::duration<Rep, Period> delay) {
@@ -0,0 +1,47 @@
+#pragma once
+
+#ifndef USE_SLOW_CALLBACK_CHECK
+#error "Slow callback checks need USE_SLOW_CALLBACK_CHECK"
+#endif
+
+#include <asyncio/handle.h>
+
+// 3rd
+#include <fmt/core.h>
+
+// std
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+
+namespace asyncio {
+
+// A handle which blocked its event loop for at least
+// EventLoop::slow_callback_duration().
+struct SlowCallback {
+  HandleId id;
+  std::chrono::nanoseconds duration;
+  // false if it is still running, when reported by a LoopWatchdog.
+  bool finished;
+  // From dump_backtrace(): the co_await the coroutine stopped at, then those
+  // of its parents, one per line. Empty if it isn't a coroutine, was
+  // destroyed while it ran, or is still running.
+  std::string backtrace;
+};
+
+using SlowCallbackHandler = std::function<void(const SlowCallback&)>;
+
+// The default handler.
+inline void print_slow_callback(const SlowCallback& slow) {
+  auto ms = std::chrono::duration<double, std::milli>(slow.duration).count();
+  std::cerr << (slow.finished
+                    ? fmt::format("Executing handle {} took {:.3f} ms\n",
+                                  slow.id, ms)
+                    : fmt::format("Event loop stalled: handle {} has been "
+                                  "running for {:.3f} ms\n",
+                                  slow.id, ms))
+            << slow.backtrace << std::flush;
+}
+
+}  // namespace asyncio
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <asyncio/event_loop.h>
+#include <asyncio/exception.h>
+#include <asyncio/task.h>
+#include <asyncio/utils/frame_pool.h>
+
+// std
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+namespace asyncio {
+
+namespace detail {
+
+template <typename R>
+struct Spawned final : SpawnedTask {
+  explicit Spawned(Task<R> task) : task(std::move(task)) {
+    auto& promise = this->task.std_h_.promise();
+    assert(!promise.parent_co_manager_ptr_);
+    promise.parent_co_manager_ptr_ = this;
+    promise.detached_ = true;
+  }
+
+  void get_result() final { task.get_result(); }
+
+  void schedule_task() { task.std_h_.promise().schedule(); }
+
+  // The nodes come from the frame pool of the thread, as the frames.
+  static void* operator new(std::size_t size) {
+    return get_frame_pool().allocate(size);
+  }
+  static void operator delete(void* ptr, std::size_t size) noexcept {
+    get_frame_pool().deallocate(ptr, size);
+  }
+
+  Task<R> task;
+};
+
+}  // namespace detail
+
+// Schedule task without keeping it: the loop of this thread owns it until it
+// finishes, and then frees its frame at once, from its final suspend point.
+// Its exception, if any, goes to the exception handler of the loop (see
+// EventLoop::set_exception_handler()), since nobody awaits it. The tasks left
+// are destroyed by loop.cancel_spawned(), or with the loop.
+//
+// It is for the tasks of an event loop, not of a WorkStealingScheduler.
+template <typename R>
+void spawn(Task<R> task) {
+  if (!task.valid()) [[unlikely]] {
+    throw InvalidFuture{};
+  }
+  auto& loop = get_event_loop();
+  if (task.done()) {
+    try {
+      task.get_result();
+    } catch (...) {
+      loop.call_exception_handler(std::current_exception());
+    }
+    return;
+  }
+  auto* spawned = new detail::Spawned<R>(std::move(task));
+  loop.add_spawned(*spawned);
+  spawned->schedule_task();
+}
+
+}  // namespace asyncio
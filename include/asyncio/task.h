@@ -6,6 +6,11 @@
 #include <asyncio/result.h>
 // include "scheduled_task.h" before "task.h" to avoid some problem
 #include <asyncio/scheduled_task.h>
+#ifdef USE_TRACING
+#include <asyncio/tracing.h>
+#endif
+#include <asyncio/utils/awaitable.h>
+#include <asyncio/utils/frame_pool.h>
 #include <asyncio/utils/future.h>
 #include <asyncio/utils/non_copyable.h>
 #include <asyncio/utils/promise.h>
@@ -14,8 +19,12 @@
 #include <fmt/core.h>
 
 // std
+#ifdef USE_WORK_STEALING
+#include <atomic>
+#endif
 #include <cassert>
 #include <coroutine>
+#include <cstddef>
 #include <iostream>
 #include <utility>
 
@@ -25,6 +34,24 @@ struct ResumeAtInitialSuspend {};
 inline constexpr ResumeAtInitialSuspend
     resume_at_initial_suspend;  // use in "gather.h"
 
+class TaskGroup;
+#ifdef USE_WORK_STEALING
+class WorkStealingScheduler;
+#endif
+
+namespace detail {
+template <typename R, typename Parent>
+class ChildTasks;
+template <typename R>
+struct Spawned;
+
+#ifndef NDEBUG
+// Frames which this thread is destroying, e.g. of a cancelled task, whose
+// locals go away without having finished. See ~TaskGroup().
+inline thread_local size_t destroying_frames = 0;
+#endif
+}  // namespace detail
+
 template <typename R = void>
 struct Task : private NonCopyable {
   struct promise_type;
@@ -32,6 +59,14 @@ struct Task : private NonCopyable {
 
   template <concepts::Future>
   friend struct ScheduledTask;
+  template <typename, typename>
+  friend class detail::ChildTasks;
+  friend class TaskGroup;
+  template <typename>
+  friend struct detail::Spawned;
+#ifdef USE_WORK_STEALING
+  friend class WorkStealingScheduler;
+#endif
 
   explicit Task(std_co_handle h) noexcept : std_h_(h) {}
   // https://en.cppreference.com/w/cpp/utility/exchange
@@ -55,6 +90,14 @@ struct Task : private NonCopyable {
     constexpr bool await_ready() {
       // A co_await B: B is sub_co_handle_, A is await_suspend's arg
       if (sub_co_handle_) [[likely]] {
+#ifdef USE_WORK_STEALING
+        // B may be finishing on another thread, don't look at its frame.
+        if (auto& sub_promise = sub_co_handle_.promise();
+            sub_promise.started_early_) {
+          return sub_promise.await_state_.load(std::memory_order_acquire) ==
+                 promise_type::AwaitState::FINISHED;
+        }
+#endif
         // If B isn't done, suspend B; else resume B.
         return sub_co_handle_.done();
       }
@@ -65,15 +108,41 @@ struct Task : private NonCopyable {
 
     // await_ready is false (B isn't done)
     template <typename Promise>
-    void await_suspend(std::coroutine_handle<Promise> parent) const noexcept {
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> parent) const noexcept {
+      auto& sub_promise = sub_co_handle_.promise();
       // CoHandleManager* parent_co_manager_ptr_;
-      assert(!sub_co_handle_.promise().parent_co_manager_ptr_);  // nullptr
+      assert(!sub_promise.parent_co_manager_ptr_);  // nullptr
       // mark parent as suspended
       parent.promise().set_state(HandleIdAndState::State::SUSPEND);
       // save parent info in this awaiter
-      sub_co_handle_.promise().parent_co_manager_ptr_ = &(parent.promise());
+      sub_promise.parent_co_manager_ptr_ = &(parent.promise());
+      sub_promise.parent_co_handle_ = parent;
+#ifdef USE_WORK_STEALING
+      if (sub_promise.started_early_) {
+        // B is already running (or queued) somewhere. It resumes A when it
+        // finishes, unless it has finished meanwhile: then resume A at once.
+        auto expected = promise_type::AwaitState::NOT_AWAITED;
+        if (!sub_promise.await_state_.compare_exchange_strong(
+                expected, promise_type::AwaitState::AWAITED,
+                std::memory_order_acq_rel)) {
+          parent.promise().set_state(HandleIdAndState::State::UNSCHEDULED);
+          return parent;
+        }
+        return std::noop_coroutine();
+      }
+#endif
+#ifdef USE_SYMMETRIC_TRANSFER
+      // B hasn't been scheduled or suspended by anything (it is at initial
+      // suspend): resume B at once instead of going through the event loop.
+      if (sub_promise.get_state() == HandleIdAndState::State::UNSCHEDULED &&
+          detail::try_symmetric_transfer()) {
+        return sub_co_handle_;
+      }
+#endif
       // send B into ready queue
-      sub_co_handle_.promise().schedule();  // SCHEDULED and into ready queue
+      sub_promise.schedule();  // SCHEDULED and into ready queue
+      return std::noop_coroutine();
     }
   };
 
@@ -115,7 +184,13 @@ struct Task : private NonCopyable {
     if (auto std_h = std::exchange(std_h_, nullptr)) {
       // after std::exchange, std_h_'s frame pointer will be nullptr
       std_h.promise().set_cancelled();
+#ifndef NDEBUG
+      ++detail::destroying_frames;
+#endif
       std_h.destroy();
+#ifndef NDEBUG
+      --detail::destroying_frames;
+#endif
     }
   }
 
@@ -141,7 +216,18 @@ struct Task<R>::promise_type : CoHandleManager, Result<R> {
   promise_type(Obj&&, ResumeAtInitialSuspend, Args&&...)
       : suspend_at_initial_suspend_{false} {}
 
+  // Coroutine frames come from the frame pool of the thread.
+  static void* operator new(std::size_t size) {
+    return get_frame_pool().allocate(size);
+  }
+  static void operator delete(void* ptr, std::size_t size) noexcept {
+    get_frame_pool().deallocate(ptr, size);
+  }
+
   Task get_return_object() noexcept {
+#ifdef USE_TRACING
+    trace_event(TraceEventType::CREATE, get_handle_id());
+#endif
     return Task{std_co_handle::from_promise(*this)};
   }
 
@@ -154,13 +240,24 @@ struct Task<R>::promise_type : CoHandleManager, Result<R> {
         return !suspend_at_initial_suspend_;
       }
       constexpr void await_suspend(std::coroutine_handle<>) const noexcept {}
+#if defined(USE_TRACING) || defined(USE_TASK_STATS)
+      void await_resume() const noexcept { promise_.on_resume({}); }
+#else
       constexpr void await_resume() const noexcept {}
+#endif
 
       const bool suspend_at_initial_suspend_;
+#if defined(USE_TRACING) || defined(USE_TASK_STATS)
+      promise_type& promise_;
+#endif
     };
     // If true (default), await_suspend(), don't resume coroutine when created.
     // If false, await_resume(), resume coroutine when created.
+#if defined(USE_TRACING) || defined(USE_TASK_STATS)
+    return InitialSuspendAwaiter{suspend_at_initial_suspend_, *this};
+#else
     return InitialSuspendAwaiter{suspend_at_initial_suspend_};
+#endif
   }
 
   // Because of template (which should have parent_co_manager_ptr_), cannot
@@ -169,15 +266,49 @@ struct Task<R>::promise_type : CoHandleManager, Result<R> {
     constexpr bool await_ready() const noexcept { return false; }
 
     template <typename Promise>
-    constexpr void await_suspend(
+    std::coroutine_handle<> await_suspend(
         std::coroutine_handle<Promise> h_final) const noexcept {
       // h_final is itself rather than parent (because this is final_suspend())
-      if (CoHandleManager* parent = h_final.promise().parent_co_manager_ptr_) {
+      auto& promise = h_final.promise();
+#ifdef USE_TRACING
+      trace_event(TraceEventType::COMPLETE, promise.get_handle_id(),
+                  promise.frame_info_);
+#endif
+#ifdef USE_TASK_STATS
+      promise.task_clock().suspended();
+#endif
+      if (promise.detached_) {
+        // Nobody awaits it: the loop reports its exception and frees it now,
+        // see spawn().
+        promise.parent_co_manager_ptr_->run();
+        return std::noop_coroutine();
+      }
+#ifdef USE_WORK_STEALING
+      if (promise.started_early_ &&
+          promise.await_state_.exchange(AwaitState::FINISHED,
+                                        std::memory_order_acq_rel) !=
+              AwaitState::AWAITED) {
+        // Not awaited yet, the parent will see it is finished.
+        return std::noop_coroutine();
+      }
+#endif
+      if (CoHandleManager* parent = promise.parent_co_manager_ptr_) {
+#ifdef USE_SYMMETRIC_TRANSFER
+        // The parent is still waiting for this task: return to it directly.
+        if (parent->get_state() == HandleIdAndState::State::SUSPEND &&
+            detail::try_symmetric_transfer()) {
+          parent->set_state(HandleIdAndState::State::UNSCHEDULED);
+#ifdef USE_SLOW_CALLBACK_CHECK
+          get_event_loop().running_handle_transferred(promise, *parent);
+#endif
+          return promise.parent_co_handle_;
+        }
+#endif
         // send parent into ready queue
         get_event_loop().set_handle_will_be_called_soon(*parent);
       }
-      // Don't return parent coroutine_handle here because tasks are controlled
-      // by event loop.
+      // Otherwise tasks are controlled by event loop.
+      return std::noop_coroutine();
     }
     constexpr void await_resume() const noexcept {}
   };
@@ -194,9 +325,41 @@ struct Task<R>::promise_type : CoHandleManager, Result<R> {
   decltype(auto) await_transform(
       A&& awaiter, std::source_location loc = std::source_location::current()) {
     frame_info_ = loc;
+#if defined(USE_TRACING) || defined(USE_TASK_STATS)
+    return detail::ObservedAwaiter<
+        decltype(detail::get_awaiter(std::forward<A>(awaiter))), promise_type>{
+        detail::get_awaiter(std::forward<A>(awaiter)), *this, loc};
+#else
     return std::forward<A>(awaiter);
+#endif
   }
 
+#if defined(USE_TRACING) || defined(USE_TASK_STATS)
+  // Called when the coroutine suspends at a co_await of await_transform(), and
+  // when it goes on after it or after initial_suspend().
+  void on_suspend(const std::source_location& where) noexcept {
+#ifdef USE_TRACING
+    trace_event(TraceEventType::SUSPEND, get_handle_id(), where);
+#endif
+#ifdef USE_TASK_STATS
+    task_clock().suspended();
+#endif
+  }
+
+  void on_resume(const std::source_location& where) noexcept {
+#ifdef USE_TRACING
+    trace_event(TraceEventType::RESUME, get_handle_id(), where);
+#endif
+#ifdef USE_TASK_STATS
+    task_clock().resumed();
+#endif
+  }
+#endif
+
+#ifdef USE_TASK_STATS
+  ~promise_type() { task_clock().flush(frame_info_); }
+#endif
+
   // Inherit HandleIdAndState
   void run() final { std_co_handle::from_promise(*this).resume(); }
 
@@ -204,18 +367,30 @@ struct Task<R>::promise_type : CoHandleManager, Result<R> {
     return frame_info_;
   }
 
-  void dump_backtrace(size_t depth) const final {
-    std::cout << fmt::format("[{}] {}", depth, frame_name()) << std::endl;
+  void dump_backtrace(size_t depth,
+                      std::ostream& out = std::cout) const final {
+    out << fmt::format("[{}] {}", depth, frame_name()) << std::endl;
     if (parent_co_manager_ptr_) {
-      parent_co_manager_ptr_->dump_backtrace(depth + 1);
+      parent_co_manager_ptr_->dump_backtrace(depth + 1, out);
     } else {
-      std::cout << std::endl;
+      out << std::endl;
     }
   }
 
   const bool suspend_at_initial_suspend_ = true;
+  // Set by spawn(), parent_co_manager_ptr_ is then a detail::SpawnedTask.
+  bool detached_ = false;
   CoHandleManager* parent_co_manager_ptr_ = nullptr;
+  std::coroutine_handle<> parent_co_handle_{};
   std::source_location frame_info_{};
+#ifdef USE_WORK_STEALING
+  // A task started before it is awaited (ResumeAtInitialSuspend or
+  // ScheduledTask) may finish on a thread of a WorkStealingScheduler while
+  // another one awaits it. Whoever comes second resumes the parent.
+  enum class AwaitState : uint8_t { NOT_AWAITED, AWAITED, FINISHED };
+  bool started_early_ = !suspend_at_initial_suspend_;
+  std::atomic<AwaitState> await_state_{AwaitState::NOT_AWAITED};
+#endif
 };
 
 static_assert(concepts::Promise<Task<>::promise_type>);
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <asyncio/event_loop.h>
+#include <asyncio/exception.h>
+#include <asyncio/handle.h>
+#include <asyncio/task.h>
+#include <asyncio/utils/frame_pool.h>
+#include <asyncio/utils/intrusive_list.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <cassert>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+namespace asyncio {
+
+// What a TaskGroup does when a child throws.
+enum class ChildError : uint8_t {
+  // Cancel the other children, and rethrow the exception from wait().
+  CANCEL_SIBLINGS /* default */,
+  // Drop the exception, the other children go on.
+  IGNORE
+};
+
+// A nursery of tasks, for a number of them which changes while they run:
+//
+//   asyncio::TaskGroup group;
+//   for (...) {
+//     group.spawn(handle(request));
+//   }
+//   co_await group.wait();
+//
+// spawn() schedules a task, and the group keeps it until it finishes. Each
+// child is a node of an intrusive list, which is also the handle the task
+// resumes when it finishes (as the task awaiting it would be): the node then
+// unlinks itself and frees the task, so a finished child costs O(1) and
+// doesn't stay alive until someone looks for it.
+//
+// The first exception cancels the other children and is rethrown by wait(),
+// and the tasks spawned after it are cancelled at once, unless the group
+// ignores errors. A destructor can't await, so destroying the group cancels
+// the children left, with the timers and the waits for IO they are suspended
+// in: await wait() before leaving its scope to let them finish. Debug builds
+// assert that children are only dropped this way when the task owning the
+// group is cancelled or an exception is thrown, or after cancel().
+//
+// It is for the tasks of an event loop, not of a WorkStealingScheduler.
+class TaskGroup : NonCopyable {
+  struct ChildBase : CoHandleManager, ListNode {
+    explicit ChildBase(TaskGroup& group) : group(group) {}
+
+    void run() final { group.child_finished(*this); }
+
+    // Rethrows the exception of the task, if any.
+    virtual void get_result() = 0;
+
+    // The nodes come from the frame pool of the thread, as the frames.
+    static void* operator new(std::size_t size) {
+      return get_frame_pool().allocate(size);
+    }
+    static void operator delete(void* ptr, std::size_t size) noexcept {
+      get_frame_pool().deallocate(ptr, size);
+    }
+
+    TaskGroup& group;
+  };
+
+  template <typename R>
+  struct Child final : ChildBase {
+    Child(TaskGroup& group, Task<R> task)
+        : ChildBase(group), task(std::move(task)) {}
+
+    void get_result() final { task.get_result(); }
+
+    Task<R> task;
+  };
+
+ public:
+  explicit TaskGroup(ChildError on_error = ChildError::CANCEL_SIBLINGS)
+      : on_error_(on_error) {}
+
+  // The children point to it.
+  TaskGroup(TaskGroup&&) = delete;
+
+  ~TaskGroup() {
+#ifndef NDEBUG
+    // Left without wait(), the children would be dropped silently.
+    assert(empty() || std::uncaught_exceptions() > 0 ||
+           detail::destroying_frames > 0);
+#endif
+    cancel();
+  }
+
+  // Schedules task, which the group owns until it finishes.
+  template <typename R>
+  void spawn(Task<R> task) {
+    if (!task.valid()) [[unlikely]] {
+      throw InvalidFuture{};
+    }
+    if (error_) {
+      // The siblings are cancelled already.
+      return;
+    }
+    auto* child = new Child<R>(*this, std::move(task));
+    child->link_before(children_);
+    ++size_;
+    if (child->task.done()) {
+      // Reported by the loop as the others, not in the middle of spawn().
+      get_event_loop().set_handle_will_be_called_soon(*child);
+      return;
+    }
+    auto& promise = child->task.std_h_.promise();
+    assert(!promise.parent_co_manager_ptr_);
+    promise.parent_co_manager_ptr_ = child;
+    promise.schedule();
+  }
+
+  // Children which haven't finished yet.
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Destroys the children which haven't finished yet.
+  void cancel() {
+    while (children_.linked()) {
+      remove(*static_cast<ChildBase*>(children_.next()));
+    }
+  }
+
+  // Awaits until no child is left, and rethrows the first exception of a
+  // child, if the group doesn't ignore them. The group can be used again
+  // after it.
+  [[nodiscard("should use co_await")]] auto wait() {
+    return WaitAwaiter{*this};
+  }
+
+ private:
+  struct WaitAwaiter {
+    bool await_ready() const noexcept { return group_.empty(); }
+
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> caller) noexcept {
+      group_.waiter_ = &caller.promise();
+      group_.waiter_->set_state(HandleIdAndState::State::SUSPEND);
+      suspended_ = true;
+    }
+
+    void await_resume() {
+      suspended_ = false;
+      if (auto error = std::exchange(group_.error_, nullptr)) {
+        std::rethrow_exception(error);
+      }
+    }
+
+    // The caller is destroyed while waiting.
+    ~WaitAwaiter() {
+      if (suspended_) {
+        group_.waiter_ = nullptr;
+      }
+    }
+
+    TaskGroup& group_;
+    bool suspended_ = false;
+  };
+
+  void remove(ChildBase& child) {
+    child.unlink();
+    --size_;
+    delete &child;
+  }
+
+  void child_finished(ChildBase& child) {
+    if (on_error_ == ChildError::CANCEL_SIBLINGS) {
+      try {
+        child.get_result();
+      } catch (...) {
+        error_ = std::current_exception();
+      }
+    }
+    remove(child);
+    if (error_) {
+      cancel();
+    }
+    if (empty() && waiter_ != nullptr) {
+      get_event_loop().set_handle_will_be_called_soon(
+          *std::exchange(waiter_, nullptr));
+    }
+  }
+
+  ChildError on_error_;
+  ListNode children_;
+  size_t size_ = 0;
+  std::exception_ptr error_;
+  CoHandleManager* waiter_ = nullptr;
+};
+
+}  // namespace asyncio
@@ -0,0 +1,119 @@
+#pragma once
+
+#ifndef USE_TASK_STATS
+#error "Task stats need USE_TASK_STATS (-DWITH_TASK_STATS=ON)"
+#endif
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <source_location>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace asyncio {
+
+// What the tasks of a coroutine function cost, added up.
+struct TaskStats {
+  uint64_t tasks = 0;    // destroyed
+  uint64_t resumes = 0;  // including the first one
+  // Running on a thread, without the tasks it runs in turn. It is wall-clock
+  // time, so it includes blocking calls, which hold the loop as well.
+  std::chrono::nanoseconds running{};
+  // From being scheduled to being resumed, in the ready queue.
+  std::chrono::nanoseconds ready_wait{};
+  // From waiting for an fd or an IO operation to the selector waking it up.
+  std::chrono::nanoseconds io_wait{};
+
+  TaskStats& operator+=(const TaskStats& other) {
+    tasks += other.tasks;
+    resumes += other.resumes;
+    running += other.running;
+    ready_wait += other.ready_wait;
+    io_wait += other.io_wait;
+    return *this;
+  }
+};
+
+struct TaskStatsEntry {
+  // Of the coroutine, empty for tasks which never co_await.
+  std::string function;
+  std::string file;
+  TaskStats stats;
+};
+
+// The stats of the tasks destroyed so far on all threads, by coroutine
+// function, the most running first.
+std::vector<TaskStatsEntry> get_task_stats();
+void reset_task_stats();
+
+namespace detail {
+
+// Times of a task, kept in its handle and added to the stats of its function
+// when it is destroyed.
+class TaskClock {
+ public:
+  // Resumed on this thread, taking over from the task running now, if any,
+  // until suspended() is called.
+  void resumed() noexcept {
+    int64_t now = now_ns();
+    if (scheduled_at_ != 0) {
+      ready_wait_ns_ += now - scheduled_at_;
+      scheduled_at_ = 0;
+    }
+    ++resumes_;
+    if (running_ != nullptr) {
+      running_->running_ns_ += now - running_->since_;
+    }
+    resumed_from_ = std::exchange(running_, this);
+    since_ = now;
+  }
+
+  // Suspended or finished, the task it took over from goes on.
+  void suspended() noexcept {
+    int64_t now = now_ns();
+    running_ns_ += now - since_;
+    running_ = std::exchange(resumed_from_, nullptr);
+    if (running_ != nullptr) {
+      running_->since_ = now;
+    }
+  }
+
+  void scheduled() noexcept { scheduled_at_ = now_ns(); }
+  void io_wait_started() noexcept { io_wait_since_ = now_ns(); }
+  void io_wait_ended() noexcept {
+    if (io_wait_since_ != 0) {
+      io_wait_ns_ += now_ns() - io_wait_since_;
+      io_wait_since_ = 0;
+    }
+  }
+
+  // Add the times to the stats of the function of where, in the table of the
+  // thread.
+  void flush(const std::source_location& where) const noexcept;
+
+ private:
+  static int64_t now_ns() noexcept {
+    return std::chrono::nanoseconds(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // The task running on this thread.
+  static inline thread_local TaskClock* running_ = nullptr;
+
+  uint64_t resumes_ = 0;
+  int64_t running_ns_ = 0;
+  int64_t ready_wait_ns_ = 0;
+  int64_t io_wait_ns_ = 0;
+  // 0 unless it is running, scheduled or waiting for IO.
+  int64_t since_ = 0;
+  int64_t scheduled_at_ = 0;
+  int64_t io_wait_since_ = 0;
+  TaskClock* resumed_from_ = nullptr;
+};
+
+}  // namespace detail
+
+}  // namespace asyncio
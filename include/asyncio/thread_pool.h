@@ -0,0 +1,81 @@
+#pragma once
+
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace asyncio {
+
+// A fixed number of worker threads running jobs in FIFO order. The jobs left
+// in the queue still run when the pool is destroyed.
+class ThreadPool : private NonCopyable {
+ public:
+  explicit ThreadPool(size_t n_threads = default_size()) {
+    threads_.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; ++i) {
+      threads_.emplace_back([this] { work(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    // threads_ is destroyed first, which joins the threads.
+  }
+
+  // Can be called from any thread.
+  void submit(std::function<void()> job) {
+    {
+      std::lock_guard lock(mutex_);
+      jobs_.push_back(std::move(job));
+    }
+    cv_.notify_one();
+  }
+
+  size_t size() const { return threads_.size(); }
+
+  static size_t default_size() {
+    return std::max(1U, std::thread::hardware_concurrency());
+  }
+
+ private:
+  void work() {
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+          return;  // stopping
+        }
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> jobs_;
+  bool stopping_ = false;
+  std::vector<std::jthread> threads_;
+};
+
+// Used by run_in_executor() without a pool. Created at the first call, with
+// ThreadPool::default_size() threads.
+ThreadPool& get_default_executor();
+
+}  // namespace asyncio
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <asyncio/event_loop.h>
+#include <asyncio/handle.h>
+#include <asyncio/scheduled_task.h>
+#include <asyncio/task.h>
+
+// std
+#include <exception>
+#include <future>
+#include <type_traits>
+#include <utility>
+
+namespace asyncio {
+
+namespace detail {
+
+// Runs a task sent by another thread on the loop, and sets the result into a
+// std::promise. It owns itself: when the task is done, it schedules itself to
+// delete everything once the runner coroutine has reached its end.
+template <typename R>
+class ThreadsafeTaskRunner : HandleIdAndState {
+ public:
+  ThreadsafeTaskRunner(Task<R>&& task, std::promise<R>&& promise)
+      : task_(std::move(task)),
+        promise_(std::move(promise)),
+        runner_(create_scheduled_task(run_task())) {}
+
+ private:
+  Task<> run_task() {
+    try {
+      if constexpr (std::is_void_v<R>) {
+        co_await std::move(task_);
+        promise_.set_value();
+      } else {
+        promise_.set_value(co_await std::move(task_));
+      }
+    } catch (...) {
+      promise_.set_exception(std::current_exception());
+    }
+    get_event_loop().set_handle_will_be_called_soon(*this);
+  }
+
+  void run() final { delete this; }
+
+  Task<R> task_;
+  std::promise<R> promise_;
+  ScheduledTask<Task<>> runner_;
+};
+
+}  // namespace detail
+
+// Run task on loop, which may be running in another thread, and get the
+// result with the returned future. Can be called from any thread; the task
+// must not have started, as a Task created without ResumeAtInitialSuspend.
+// Don't wait for the future on the thread of loop itself, it never completes.
+template <typename R>
+std::future<R> run_coroutine_threadsafe(Task<R> task, EventLoop& loop) {
+  std::promise<R> promise;
+  auto future = promise.get_future();
+  loop.call_soon_threadsafe(
+      [task = std::move(task), promise = std::move(promise)]() mutable {
+        new detail::ThreadsafeTaskRunner<R>(std::move(task),
+                                            std::move(promise));
+      });
+  return future;
+}
+
+}  // namespace asyncio
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <asyncio/utils/intrusive_list.h>
+
+// std
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace asyncio {
+
+class HandleIdAndState;
+
+// A timer in TimingWheel or TimerHeap. It is embedded in the handle to wake up,
+// so adding and cancelling a timer never allocate, and a cancelled timer is
+// removed from the queue at once.
+struct TimerEntry : ListNode {
+  explicit TimerEntry(HandleIdAndState* owner = nullptr) noexcept
+      : handle(owner) {}
+
+  bool queued() const noexcept {
+    return linked() || heap_index != kNotInHeap;
+  }
+
+  HandleIdAndState* handle;
+  std::chrono::milliseconds when{};
+  // position in TimingWheel
+  uint8_t level = 0;
+  uint8_t slot = 0;
+  // position in TimerHeap
+  size_t heap_index = kNotInHeap;
+
+  constexpr static size_t kNotInHeap = SIZE_MAX;
+};
+
+}  // namespace asyncio
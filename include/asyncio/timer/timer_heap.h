@@ -0,0 +1,106 @@
+#pragma once
+
+#include <asyncio/timer/timer_entry.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace asyncio {
+
+// Binary min-heap of timers. Each entry remembers its index, so a cancelled
+// timer is removed at once in O(log n) instead of staying in the heap until it
+// reaches the top.
+class TimerHeap : private NonCopyable {
+  using MSDuration = std::chrono::milliseconds;
+
+ public:
+  void insert(TimerEntry& entry, MSDuration when) {
+    entry.when = when;
+    entry.heap_index = heap_.size();
+    heap_.push_back(&entry);
+    sift_up(entry.heap_index);
+  }
+
+  void erase(TimerEntry& entry) { remove_at(entry.heap_index); }
+
+  bool empty() const { return heap_.empty(); }
+
+  size_t size() const { return heap_.size(); }
+
+  // The earliest time expire() has something to do. std::nullopt if empty.
+  std::optional<MSDuration> next_expiry() const {
+    if (heap_.empty()) {
+      return std::nullopt;
+    }
+    return heap_[0]->when + MSDuration(1);
+  }
+
+  // Remove the timers whose `when` is before now, and call
+  // on_expired(TimerEntry&) for each of them in order.
+  template <typename F>
+  void expire(MSDuration now, F&& on_expired) {
+    while (!heap_.empty() && heap_[0]->when < now) {
+      auto& entry = *heap_[0];
+      remove_at(0);
+      on_expired(entry);
+    }
+  }
+
+ private:
+  void remove_at(size_t index) {
+    heap_[index]->heap_index = TimerEntry::kNotInHeap;
+    auto* last = heap_.back();
+    heap_.pop_back();
+    if (index < heap_.size()) {
+      place(last, index);
+      sift_down(index);
+      sift_up(index);
+    }
+  }
+
+  void sift_up(size_t index) {
+    auto* entry = heap_[index];
+    while (index > 0) {
+      size_t parent = (index - 1) / 2;
+      if (!(entry->when < heap_[parent]->when)) {
+        break;
+      }
+      place(heap_[parent], index);
+      index = parent;
+    }
+    place(entry, index);
+  }
+
+  void sift_down(size_t index) {
+    auto* entry = heap_[index];
+    size_t n = heap_.size();
+    while (true) {
+      size_t child = index * 2 + 1;
+      if (child >= n) {
+        break;
+      }
+      if (child + 1 < n && heap_[child + 1]->when < heap_[child]->when) {
+        ++child;
+      }
+      if (!(heap_[child]->when < entry->when)) {
+        break;
+      }
+      place(heap_[child], index);
+      index = child;
+    }
+    place(entry, index);
+  }
+
+  void place(TimerEntry* entry, size_t index) {
+    heap_[index] = entry;
+    entry->heap_index = index;
+  }
+
+  std::vector<TimerEntry*> heap_;
+};
+
+}  // namespace asyncio
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <asyncio/timer/timer_entry.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace asyncio {
+
+// Hierarchical timing wheel with 1ms ticks, as in the Linux kernel and tokio.
+// Level n has kSlots slots of kSlots^n ms each, so the kLevels levels cover
+// kSlots^kLevels ms (about 795 days, later timers are kept in the top level
+// until they get close). Inserting and cancelling a timer are O(1): it is
+// linked into the slot of the highest level where its deadline differs from
+// the wheel time. When the time reaches a slot of a higher level, the timers
+// in it are moved down to the lower levels.
+class TimingWheel : private NonCopyable {
+  using MSDuration = std::chrono::milliseconds;
+
+ public:
+  void insert(TimerEntry& entry, MSDuration when) {
+    // A timer in the past is put into the current slot and fires at once.
+    entry.when = std::max(when, MSDuration(elapsed_));
+    place(entry);
+    ++size_;
+  }
+
+  void erase(TimerEntry& entry) {
+    entry.unlink();
+    if (!slots_[entry.level][entry.slot].linked()) {
+      occupied_[entry.level] &= ~(uint64_t{1} << entry.slot);
+    }
+    --size_;
+  }
+
+  bool empty() const { return size_ == 0; }
+
+  size_t size() const { return size_; }
+
+  // The earliest time expire() has something to do: fire timers or move them
+  // down to a lower level. std::nullopt if empty.
+  std::optional<MSDuration> next_expiry() const {
+    if (auto expiration = next_expiration()) {
+      return MSDuration(expiration->deadline + 1);
+    }
+    return std::nullopt;
+  }
+
+  // Remove the timers whose `when` is before now, and call
+  // on_expired(TimerEntry&) for each of them in order.
+  template <typename F>
+  void expire(MSDuration now, F&& on_expired) {
+    if (now.count() <= 0) {
+      return;
+    }
+    // The last tick to process.
+    auto last = static_cast<uint64_t>(now.count() - 1);
+    while (auto expiration = next_expiration()) {
+      if (expiration->deadline > last) {
+        break;
+      }
+      elapsed_ = expiration->deadline;
+      // Take the whole slot first, a timer far in the future may go back to
+      // the same slot of the top level.
+      ListNode entries;
+      entries.splice(slots_[expiration->level][expiration->slot]);
+      occupied_[expiration->level] &= ~(uint64_t{1} << expiration->slot);
+      while (entries.linked()) {
+        auto& entry = static_cast<TimerEntry&>(*entries.next());
+        entry.unlink();
+        if (expiration->level == 0) {
+          --size_;
+          on_expired(entry);
+        } else {
+          place(entry);
+        }
+      }
+    }
+    elapsed_ = std::max(elapsed_, last);
+  }
+
+ private:
+  constexpr static int kBitsPerLevel = 6;
+  constexpr static size_t kSlots = size_t{1} << kBitsPerLevel;
+  constexpr static size_t kLevels = 6;
+  constexpr static uint64_t kMaxDuration = uint64_t{1}
+                                           << (kBitsPerLevel * kLevels);
+
+  struct Expiration {
+    size_t level;
+    size_t slot;
+    uint64_t deadline;  // start of the slot
+  };
+
+  void place(TimerEntry& entry) {
+    auto when = static_cast<uint64_t>(entry.when.count());
+    // The highest bit where the deadline differs from the wheel time decides
+    // the level, so the slot is always after the current one of that level.
+    uint64_t masked = (elapsed_ ^ when) | (kSlots - 1);
+    if (masked >= kMaxDuration) {
+      masked = kMaxDuration - 1;
+    }
+    size_t level = (63 - std::countl_zero(masked)) / kBitsPerLevel;
+    size_t slot = (when >> (level * kBitsPerLevel)) % kSlots;
+    entry.level = static_cast<uint8_t>(level);
+    entry.slot = static_cast<uint8_t>(slot);
+    entry.link_before(slots_[level][slot]);
+    occupied_[level] |= uint64_t{1} << slot;
+  }
+
+  // The first occupied slot from the lowest level. A slot of a lower level is
+  // always before any occupied slot of a higher level.
+  std::optional<Expiration> next_expiration() const {
+    for (size_t level = 0; level < kLevels; ++level) {
+      uint64_t occupied = occupied_[level];
+      if (occupied == 0) {
+        continue;
+      }
+      uint64_t slot_range = uint64_t{1} << (level * kBitsPerLevel);
+      uint64_t level_range = slot_range * kSlots;
+      auto from = static_cast<int>((elapsed_ / slot_range) % kSlots);
+      // A timer beyond the wheel stays in the top level, which wraps around,
+      // so there the current slot and the slots before it belong to the next
+      // round.
+      bool top = level == kLevels - 1;
+      if (top) {
+        from = (from + 1) % kSlots;
+      }
+      size_t slot =
+          (std::countr_zero(std::rotr(occupied, from)) + from) % kSlots;
+      uint64_t deadline = (elapsed_ & ~(level_range - 1)) + slot * slot_range;
+      if (top && deadline <= elapsed_) {
+        deadline += level_range;
+      }
+      return Expiration{level, slot, deadline};
+    }
+    return std::nullopt;
+  }
+
+  uint64_t elapsed_ = 0;  // wheel time in ms, the last processed tick
+  std::array<std::array<ListNode, kSlots>, kLevels> slots_;
+  std::array<uint64_t, kLevels> occupied_{};
+  size_t size_ = 0;
+};
+
+}  // namespace asyncio
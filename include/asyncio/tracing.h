@@ -0,0 +1,113 @@
+#pragma once
+
+#ifndef USE_TRACING
+#error "Tracing needs USE_TRACING (-DWITH_TRACING=ON)"
+#endif
+
+#include <asyncio/handle.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <source_location>
+#include <vector>
+
+namespace asyncio {
+
+enum class TraceEventType : uint8_t {
+  CREATE,    // a Task is created
+  SCHEDULE,  // a handle goes into the ready queue
+  RESUME,    // a Task starts, or goes on after a co_await
+  SUSPEND,   // a Task suspends at a co_await
+  COMPLETE,  // a Task reaches its end
+  IO_WAIT,   // a Task starts waiting for an fd or an IO operation
+  IO_READY,  // the selector wakes it up
+};
+
+struct TraceEvent {
+  int64_t time_ns;  // steady clock
+  HandleId id;
+  // The co_await for RESUME and SUSPEND, the last one for COMPLETE.
+  std::source_location where;
+  TraceEventType type;
+};
+
+// Last events of a thread, in a ring which overwrites the oldest ones. Only
+// the owner thread records, and takes no lock. Another thread can take a
+// snapshot meanwhile, without the events overwritten while it copies them.
+class TraceBuffer : private NonCopyable {
+ public:
+  constexpr static size_t kDefaultCapacity = size_t{1} << 16;
+
+  TraceBuffer(size_t thread_index, size_t capacity = kDefaultCapacity)
+      : thread_index_(thread_index),
+        mask_(std::bit_ceil(capacity) - 1),
+        events_(std::make_unique<TraceEvent[]>(mask_ + 1)) {}
+
+  void record(TraceEventType type, HandleId id,
+              const std::source_location& where = {}) noexcept {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    events_[head & mask_] = {
+        .time_ns = std::chrono::nanoseconds(now).count(),
+        .id = id,
+        .where = where,
+        .type = type};
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  std::vector<TraceEvent> snapshot() const {
+    size_t capacity = mask_ + 1;
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t first = head > capacity ? head - capacity : 0;
+    std::vector<TraceEvent> events;
+    events.reserve(head - first);
+    for (uint64_t i = first; i < head; ++i) {
+      events.push_back(events_[i & mask_]);
+    }
+    // Drop the ones the owner may have overwritten while they were copied,
+    // including the one it may be writing now.
+    uint64_t new_head = head_.load(std::memory_order_acquire);
+    if (uint64_t kept = new_head + 1 > capacity ? new_head + 1 - capacity : 0;
+        kept > first) {
+      auto n_lost = static_cast<ptrdiff_t>(std::min(kept, head) - first);
+      events.erase(events.begin(), events.begin() + n_lost);
+    }
+    return events;
+  }
+
+  // Order of the threads by their first event, used as tid in the trace.
+  size_t thread_index() const { return thread_index_; }
+
+ private:
+  size_t thread_index_;
+  size_t mask_;
+  std::unique_ptr<TraceEvent[]> events_;
+  std::atomic<uint64_t> head_{0};
+};
+
+// Trace buffer of the calling thread. It is kept after the thread exits, so
+// that its events are in the next dump.
+TraceBuffer& get_trace_buffer();
+
+inline void trace_event(TraceEventType type, HandleId id,
+                        const std::source_location& where = {}) noexcept {
+  get_trace_buffer().record(type, id, where);
+}
+
+// Write the events of all threads in the Chrome trace event format (JSON),
+// which chrome://tracing and https://ui.perfetto.dev load:
+// - a slice from each RESUME to the next SUSPEND or COMPLETE of the Task,
+//   named by its function, with where it was resumed and suspended;
+// - an async span per wait for IO, named by the co_await it waits at;
+// - instant events for CREATE and SCHEDULE.
+void dump_chrome_trace(std::ostream& out);
+
+}  // namespace asyncio
@@ -3,6 +3,7 @@
 // std
 #include <concepts>
 #include <coroutine>
+#include <source_location>
 #include <utility>
 
 namespace asyncio {
@@ -29,6 +30,47 @@ struct GetAwaiter<A>
 template <typename A>
 using GetAwaiter_t = typename GetAwaiter<A>::type;
 
+// The awaiter of a, as co_await gets it: the result of operator co_await, or
+// a reference to a itself.
+template <typename A>
+decltype(auto) get_awaiter(A&& a) {
+  if constexpr (requires { std::forward<A>(a).operator co_await(); }) {
+    return std::forward<A>(a).operator co_await();
+  } else if constexpr (requires { operator co_await(std::forward<A>(a)); }) {
+    return operator co_await(std::forward<A>(a));
+  } else {
+    return std::forward<A>(a);
+  }
+}
+
+// Wraps an awaiter to tell observer where the coroutine suspends and goes on,
+// see Task::promise_type::await_transform().
+template <typename Awaiter, typename Observer>
+struct ObservedAwaiter {
+  bool await_ready() { return awaiter.await_ready(); }
+
+  template <typename Promise>
+  decltype(auto) await_suspend(std::coroutine_handle<Promise> handle) {
+    // Before the inner awaiter, which may hand the coroutine to another
+    // thread or destroy it.
+    observer.on_suspend(where);
+    suspended = true;
+    return awaiter.await_suspend(handle);
+  }
+
+  decltype(auto) await_resume() {
+    if (suspended) {
+      observer.on_resume(where);
+    }
+    return awaiter.await_resume();
+  }
+
+  Awaiter awaiter;
+  Observer& observer;
+  std::source_location where;
+  bool suspended = false;
+};
+
 }  // namespace detail
 
 namespace concepts {
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace asyncio {
+
+// Work-stealing deque of pointers (Chase and Lev, "Dynamic Circular
+// Work-Stealing Deque", with the C11 memory orders of Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models"). The owner thread pushes
+// and pops at the bottom, other threads steal from the top.
+//
+// The buffer doubles when it is full. Old buffers may still be read by
+// thieves, so they are kept until the deque is destroyed.
+template <typename T>
+class ChaseLevDeque : private NonCopyable {
+  class Buffer {
+   public:
+    explicit Buffer(size_t capacity)
+        : mask_(capacity - 1),
+          slots_(std::make_unique<std::atomic<T*>[]>(capacity)) {}
+
+    size_t capacity() const { return mask_ + 1; }
+
+    T* get(int64_t i) const {
+      return slots_[i & mask_].load(std::memory_order_relaxed);
+    }
+
+    void put(int64_t i, T* value) {
+      slots_[i & mask_].store(value, std::memory_order_relaxed);
+    }
+
+   private:
+    size_t mask_;
+    std::unique_ptr<std::atomic<T*>[]> slots_;
+  };
+
+ public:
+  explicit ChaseLevDeque(size_t capacity = kDefaultCapacity) {
+    buffers_.push_back(std::make_unique<Buffer>(capacity));
+    buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+  }
+
+  // Owner only.
+  void push(T* value) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    if (bottom - top > static_cast<int64_t>(buffer->capacity()) - 1) {
+      buffer = grow(buffer, top, bottom);
+    }
+    buffer->put(bottom, value);
+    // Publishes value, and what it points to, to thieves.
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  // Owner only. Take the newest one, nullptr if empty.
+  T* pop() {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    if (top > bottom) {  // empty
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T* value = buffer->get(bottom);
+    if (top == bottom) {
+      // The last one, race with thieves for it.
+      if (!top_.compare_exchange_strong(top, top + 1,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        value = nullptr;
+      }
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return value;
+  }
+
+  // Any thread. Take the oldest one, nullptr if empty or lost a race.
+  T* steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return nullptr;
+    }
+    T* value = buffer_.load(std::memory_order_consume)->get(top);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return value;
+  }
+
+  // Any thread, may be stale.
+  bool empty() const {
+    return top_.load(std::memory_order_relaxed) >=
+           bottom_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  constexpr static size_t kDefaultCapacity = 256;
+
+  Buffer* grow(Buffer* buffer, int64_t top, int64_t bottom) {
+    auto bigger = std::make_unique<Buffer>(buffer->capacity() * 2);
+    for (int64_t i = top; i < bottom; ++i) {
+      bigger->put(i, buffer->get(i));
+    }
+    buffers_.push_back(std::move(bigger));
+    buffer = buffers_.back().get();
+    buffer_.store(buffer, std::memory_order_release);
+    return buffer;
+  }
+
+  // Separate cache lines, top_ is written by thieves and bottom_ by the owner.
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Buffer*> buffer_;
+  // Owner only.
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+}  // namespace asyncio
@@ -0,0 +1,36 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <string_view>
+
+namespace asyncio {
+
+namespace detail {
+
+// Name of a coroutine from std::source_location::function_name() in its body.
+// GCC names its actor there, e.g. "void f(f(int)::_Z1fi.Frame*)": keep
+// "f(int)", the parameter of the actor without its mangled suffix. Other
+// names are kept as they are.
+inline std::string_view coroutine_name(std::string_view function) {
+  constexpr std::string_view kFrameSuffix = ".Frame*)";
+  if (!function.ends_with(kFrameSuffix)) {
+    return function;
+  }
+  // The '(' matching the last ')'.
+  size_t depth = 0;
+  size_t open = function.size() - 1;
+  for (; open > 0; --open) {
+    if (function[open] == ')') {
+      ++depth;
+    } else if (function[open] == '(' && --depth == 0) {
+      break;
+    }
+  }
+  auto inner = function.substr(open + 1);
+  return inner.substr(0, inner.rfind("::_Z"));
+}
+
+}  // namespace detail
+
+}  // namespace asyncio
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <array>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace asyncio {
+
+// Free lists of coroutine frames by size class, one pool per thread (so per
+// event loop). A frame freed into the pool is reused by the next frame of the
+// same size class without calling operator new again.
+class FramePool : private NonCopyable {
+ public:
+  struct Stats {
+    size_t hits = 0;        // allocations served from the free lists
+    size_t misses = 0;      // allocations from operator new
+    size_t bytes_held = 0;  // bytes of free frames kept in the pool
+  };
+
+  FramePool() = default;
+
+  ~FramePool() { trim(); }
+
+  void* allocate(size_t size) {
+    size_t size_class = size_class_of(size);
+    if (size_class < kSizeClasses) {
+      if (auto* block = free_lists_[size_class]; block != nullptr) {
+        free_lists_[size_class] = block->next;
+        stats_.bytes_held -= block_size(size_class);
+        bytes_held_by_class_[size_class] -= block_size(size_class);
+        ++stats_.hits;
+        return block;
+      }
+      size = block_size(size_class);
+    }
+    ++stats_.misses;
+    return ::operator new(size);
+  }
+
+  void deallocate(void* ptr, size_t size) noexcept {
+    size_t size_class = size_class_of(size);
+    if (size_class < kSizeClasses &&
+        stats_.bytes_held + block_size(size_class) <= kMaxBytesHeld &&
+        bytes_held_by_class_[size_class] + block_size(size_class) <=
+            kMaxBytesHeldByClass) {
+      free_lists_[size_class] = new (ptr) Block{free_lists_[size_class]};
+      stats_.bytes_held += block_size(size_class);
+      bytes_held_by_class_[size_class] += block_size(size_class);
+    } else {
+      ::operator delete(ptr);
+    }
+  }
+
+  // Give the free frames back to operator delete.
+  void trim() noexcept {
+    for (auto& block : free_lists_) {
+      while (block != nullptr) {
+        ::operator delete(std::exchange(block, block->next));
+      }
+    }
+    bytes_held_by_class_ = {};
+    stats_.bytes_held = 0;
+  }
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  // Frames are rounded up to kGranularity bytes. Larger frames than the
+  // largest class always use operator new.
+  constexpr static size_t kGranularity = 64;
+  constexpr static size_t kSizeClasses = 32;  // up to 2KB
+  // Don't keep more free frames than this after a burst, and leave room for
+  // the other size classes after a burst of one.
+  constexpr static size_t kMaxBytesHeld = size_t{16} << 20;
+  constexpr static size_t kMaxBytesHeldByClass = kMaxBytesHeld / 4;
+
+  struct Block {
+    Block* next;
+  };
+
+  constexpr static size_t size_class_of(size_t size) {
+    return (size + kGranularity - 1) / kGranularity - 1;
+  }
+
+  constexpr static size_t block_size(size_t size_class) {
+    return (size_class + 1) * kGranularity;
+  }
+
+  std::array<Block*, kSizeClasses> free_lists_{};
+  std::array<size_t, kSizeClasses> bytes_held_by_class_{};
+  Stats stats_;
+};
+
+// Frame pool of the calling thread.
+FramePool& get_frame_pool();
+
+}  // namespace asyncio
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace asyncio {
+
+// Counts of a Histogram at some point.
+struct HistogramSnapshot {
+  // The smallest value v such that p percent of the values are <= v, up to
+  // the precision of the histogram. 0 if empty.
+  uint64_t percentile(double p) const;
+
+  double mean() const {
+    return count == 0 ? 0 : static_cast<double>(sum) / count;
+  }
+
+  std::vector<uint64_t> counts;  // by bucket
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t max = 0;
+};
+
+// Log-linear histogram of integer values, as HdrHistogram: values below
+// kSubBuckets are exact, and each larger power of two is split into
+// kSubBuckets buckets, so a value is known within 1/kSubBuckets of it. Values
+// from kMaxValue up are counted as kMaxValue.
+//
+// Only one thread records values, any thread can take a snapshot. Recording
+// is a few plain loads and stores, with no read-modify-write.
+class Histogram : private NonCopyable {
+ public:
+  constexpr static unsigned kSubBucketBits = 4;
+  constexpr static uint64_t kSubBuckets = uint64_t{1} << kSubBucketBits;
+  constexpr static unsigned kMaxBits = 40;  // 18 minutes in ns
+  constexpr static uint64_t kMaxValue = (uint64_t{1} << kMaxBits) - 1;
+  constexpr static size_t kBuckets = (kMaxBits - kSubBucketBits + 1)
+                                     << kSubBucketBits;
+
+  constexpr static size_t bucket_of(uint64_t value) {
+    value = std::min(value, kMaxValue);
+    if (value < kSubBuckets) {
+      return value;
+    }
+    unsigned shift = std::bit_width(value) - 1 - kSubBucketBits;
+    return ((shift + 1) << kSubBucketBits) +
+           ((value >> shift) & (kSubBuckets - 1));
+  }
+
+  // The smallest value in bucket.
+  constexpr static uint64_t bucket_value(size_t bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    unsigned shift = (bucket >> kSubBucketBits) - 1;
+    return (kSubBuckets | (bucket & (kSubBuckets - 1))) << shift;
+  }
+
+  void record(uint64_t value) noexcept {
+    increase(buckets_[bucket_of(value)], 1);
+    increase(sum_, value);
+    if (value > max_.load(std::memory_order_relaxed)) {
+      max_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  HistogramSnapshot snapshot() const {
+    HistogramSnapshot snapshot;
+    snapshot.counts.resize(kBuckets);
+    for (size_t i = 0; i < kBuckets; ++i) {
+      snapshot.counts[i] = buckets_[i].load(std::memory_order_relaxed);
+      // Added up here, so that it matches the buckets even while recording.
+      snapshot.count += snapshot.counts[i];
+    }
+    snapshot.sum = sum_.load(std::memory_order_relaxed);
+    snapshot.max = max_.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+ private:
+  static void increase(std::atomic<uint64_t>& cell, uint64_t n) noexcept {
+    cell.store(cell.load(std::memory_order_relaxed) + n,
+               std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+inline uint64_t HistogramSnapshot::percentile(double p) const {
+  if (count == 0) {
+    return 0;
+  }
+  auto rank = static_cast<uint64_t>(
+      std::ceil(std::clamp(p, 0.0, 100.0) / 100 * static_cast<double>(count)));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      // The largest value of the bucket, but no more than the max seen.
+      uint64_t highest = i + 1 < Histogram::kBuckets
+                             ? Histogram::bucket_value(i + 1) - 1
+                             : Histogram::kMaxValue;
+      return std::min(highest, max);
+    }
+  }
+  return max;
+}
+
+}  // namespace asyncio
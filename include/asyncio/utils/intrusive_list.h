@@ -0,0 +1,52 @@
+#pragma once
+
+namespace asyncio {
+
+// Node of an intrusive circular doubly-linked list. The list itself is a node
+// used as the head, a node which isn't in any list points to itself. Linking
+// and unlinking never allocate.
+class ListNode {
+ public:
+  ListNode() noexcept = default;
+  ListNode(const ListNode&) = delete;
+  ListNode& operator=(const ListNode&) = delete;
+  ~ListNode() { unlink(); }
+
+  // For a node: it is in a list. For a head: the list isn't empty.
+  bool linked() const noexcept { return next_ != this; }
+
+  ListNode* next() const noexcept { return next_; }
+  ListNode* prev() const noexcept { return prev_; }
+
+  // Insert this node before pos. If pos is a head, push it back to the list.
+  void link_before(ListNode& pos) noexcept {
+    prev_ = pos.prev_;
+    next_ = &pos;
+    prev_->next_ = this;
+    pos.prev_ = this;
+  }
+
+  void unlink() noexcept {
+    prev_->next_ = next_;
+    next_->prev_ = prev_;
+    prev_ = next_ = this;
+  }
+
+  // Move all nodes of the list headed by other to the back of this list.
+  void splice(ListNode& other) noexcept {
+    if (!other.linked()) {
+      return;
+    }
+    other.next_->prev_ = prev_;
+    prev_->next_ = other.next_;
+    other.prev_->next_ = this;
+    prev_ = other.prev_;
+    other.prev_ = other.next_ = &other;
+  }
+
+ private:
+  ListNode* prev_ = this;
+  ListNode* next_ = this;
+};
+
+}  // namespace asyncio
@@ -0,0 +1,48 @@
+#pragma once
+
+// std
+#include <atomic>
+
+namespace asyncio {
+
+// Intrusive multi-producer single-consumer queue. Producers push nodes with a
+// CAS on the head of a stack and never block each other; the consumer takes
+// the whole stack at once and reverses it into FIFO order. Node needs a
+// `Node* next` member.
+template <typename Node>
+class MpscQueue {
+ public:
+  // Can be called from any thread. Return true if the queue was empty, i.e.
+  // the consumer may need to be woken up.
+  bool push(Node* node) noexcept {
+    Node* head = head_.load(std::memory_order_relaxed);
+    do {
+      node->next = head;
+    } while (!head_.compare_exchange_weak(head, node, std::memory_order_release,
+                                          std::memory_order_relaxed));
+    return head == nullptr;
+  }
+
+  // Consumer only. Take all the nodes, return the oldest one, linked by next
+  // in the order they were pushed.
+  Node* pop_all() noexcept {
+    Node* head = head_.exchange(nullptr, std::memory_order_acquire);
+    Node* first = nullptr;
+    while (head != nullptr) {
+      Node* next = head->next;
+      head->next = first;
+      first = head;
+      head = next;
+    }
+    return first;
+  }
+
+  bool empty() const noexcept {
+    return head_.load(std::memory_order_acquire) == nullptr;
+  }
+
+ private:
+  std::atomic<Node*> head_{nullptr};
+};
+
+}  // namespace asyncio
@@ -0,0 +1,60 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace asyncio {
+
+// FIFO queue in one contiguous buffer, used as a circular array. The capacity
+// is a power of two and doubles when it is full, it never shrinks, so a queue
+// which has reached its usual length doesn't allocate any more.
+template <typename T>
+class RingBuffer {
+ public:
+  bool empty() const noexcept { return size_ == 0; }
+  size_t size() const noexcept { return size_; }
+  size_t capacity() const noexcept { return buffer_.size(); }
+
+  // i-th element from the front.
+  T& operator[](size_t i) noexcept { return buffer_[(head_ + i) & mask_]; }
+  const T& operator[](size_t i) const noexcept {
+    return buffer_[(head_ + i) & mask_];
+  }
+
+  T& front() noexcept { return buffer_[head_]; }
+
+  void push_back(T value) {
+    if (size_ == buffer_.size()) {
+      grow();
+    }
+    buffer_[(head_ + size_) & mask_] = std::move(value);
+    ++size_;
+  }
+
+  void pop_front() noexcept {
+    head_ = (head_ + 1) & mask_;
+    --size_;
+  }
+
+ private:
+  constexpr static size_t kMinCapacity = 64;
+
+  void grow() {
+    std::vector<T> buffer(buffer_.empty() ? kMinCapacity : buffer_.size() * 2);
+    for (size_t i = 0; i < size_; ++i) {
+      buffer[i] = std::move((*this)[i]);
+    }
+    buffer_ = std::move(buffer);
+    mask_ = buffer_.size() - 1;
+    head_ = 0;
+  }
+
+  std::vector<T> buffer_;
+  size_t mask_ = 0;
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+
+}  // namespace asyncio
@@ -0,0 +1,196 @@
+#pragma once
+
+#ifndef USE_WORK_STEALING
+#error "WorkStealingScheduler needs USE_WORK_STEALING (-DWITH_WORK_STEALING=ON)"
+#endif
+
+#include <asyncio/event_loop.h>
+#include <asyncio/handle.h>
+#include <asyncio/task.h>
+#include <asyncio/thread_pool.h>
+#include <asyncio/utils/chase_lev_deque.h>
+#include <asyncio/utils/non_copyable.h>
+
+// std
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace asyncio {
+
+// Runs CPU-bound tasks on n worker threads (M:N). Each worker has a deque of
+// ready handles: what a task schedules (the tasks it awaits, ScheduledTask,
+// the children of gather(), its parent when it finishes) goes into the deque
+// of the worker running it. A worker runs the newest handle of its own deque,
+// and when it is empty, steals the oldest one of another worker. Workers with
+// nothing to do sleep on a futex until something is pushed.
+//
+// Tasks move between threads at every co_await, so they must not use
+// thread_local state, sleep, wait for IO or be cancelled while running.
+// Blocking or timed work belongs to an event loop and its executor.
+class WorkStealingScheduler : private NonCopyable {
+  struct Worker final : detail::ReadySink {
+    Worker(WorkStealingScheduler& scheduler, size_t index)
+        : scheduler(scheduler), victim_seed(index + 1) {}
+
+    void push(HandleIdAndState& handle) final {
+      deque.push(&handle);
+      scheduler.wake_one();
+    }
+
+    WorkStealingScheduler& scheduler;
+    uint64_t victim_seed;
+    ChaseLevDeque<HandleIdAndState> deque;
+  };
+
+  // Resumed by the root task when it has finished, after its frame is
+  // suspended for good, so the caller can destroy it.
+  struct RootWaiter final : CoHandleManager {
+    void run() final { done.set_value(); }
+
+    std::promise<void> done;
+  };
+
+ public:
+  explicit WorkStealingScheduler(
+      size_t n_threads = ThreadPool::default_size()) {
+    workers_.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; ++i) {
+      workers_.push_back(std::make_unique<Worker>(*this, i));
+    }
+    threads_.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; ++i) {
+      threads_.emplace_back([this, i] { work(*workers_[i]); });
+    }
+  }
+
+  // Waits for the tasks which are still running.
+  ~WorkStealingScheduler() {
+    stopping_.store(true, std::memory_order_seq_cst);
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    epoch_.notify_all();
+    threads_.clear();  // join
+  }
+
+  // Run task on the workers and return its result, or rethrow its exception.
+  // The calling thread waits, so it must not be one of the workers. The task
+  // must not have started, as a Task created without ResumeAtInitialSuspend.
+  template <typename R>
+  R run(Task<R> task) {
+    assert(get_event_loop().ready_sink() == nullptr);
+    auto& promise = task.std_h_.promise();
+    assert(!promise.started_early_ && !task.done());
+    RootWaiter waiter;
+    auto done = waiter.done.get_future();
+    promise.parent_co_manager_ptr_ = &waiter;
+    promise.set_state(HandleIdAndState::State::SCHEDULED);
+    promise.set_loop(&get_event_loop());
+    {
+      std::lock_guard lock(injected_mutex_);
+      injected_.push_back(&promise);
+      has_injected_.store(true, std::memory_order_relaxed);
+    }
+    wake_one();
+    done.wait();
+    return std::move(task).get_result();
+  }
+
+  size_t size() const { return workers_.size(); }
+
+ private:
+  void work(Worker& self) {
+    get_event_loop().set_ready_sink(&self);
+    while (auto* handle = next_handle(self)) {
+      // When running, the state may be changed. So unschedule it first.
+      handle->set_state(HandleIdAndState::State::UNSCHEDULED);
+      handle->run();
+    }
+    get_event_loop().set_ready_sink(nullptr);
+  }
+
+  // nullptr if stopping and there is nothing left to run.
+  HandleIdAndState* next_handle(Worker& self) {
+    while (true) {
+      if (auto* handle = find_handle(self)) {
+        return handle;
+      }
+      // Announce the sleep before looking for the last time. A push either
+      // sees the sleeper and bumps the epoch, or is seen by that last look.
+      uint32_t epoch = epoch_.load(std::memory_order_seq_cst);
+      sleepers_.fetch_add(1, std::memory_order_seq_cst);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      auto* handle = find_handle(self);
+      if (handle == nullptr && !stopping_.load(std::memory_order_seq_cst)) {
+        epoch_.wait(epoch, std::memory_order_seq_cst);
+      }
+      sleepers_.fetch_sub(1, std::memory_order_relaxed);
+      if (handle != nullptr) {
+        return handle;
+      }
+      if (stopping_.load(std::memory_order_seq_cst)) {
+        // Another worker may still be running a task which pushes more, but
+        // then that one is not idle and runs them itself.
+        return find_handle(self);
+      }
+    }
+  }
+
+  HandleIdAndState* find_handle(Worker& self) {
+    if (auto* handle = self.deque.pop()) {
+      return handle;
+    }
+    if (has_injected_.load(std::memory_order_relaxed)) {
+      std::lock_guard lock(injected_mutex_);
+      if (!injected_.empty()) {
+        auto* handle = injected_.front();
+        injected_.pop_front();
+        has_injected_.store(!injected_.empty(), std::memory_order_relaxed);
+        return handle;
+      }
+    }
+    // Start at a random victim, so that thieves don't pile up on one deque.
+    size_t n = workers_.size();
+    self.victim_seed ^= self.victim_seed << 13;
+    self.victim_seed ^= self.victim_seed >> 7;
+    self.victim_seed ^= self.victim_seed << 17;
+    for (size_t i = 0, first = self.victim_seed % n; i < n; ++i) {
+      auto& victim = *workers_[(first + i) % n];
+      if (&victim != &self) {
+        if (auto* handle = victim.deque.steal()) {
+          return handle;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  void wake_one() {
+    // Pairs with the increment of sleepers_ in next_handle().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) > 0) {
+      epoch_.fetch_add(1, std::memory_order_seq_cst);
+      epoch_.notify_one();
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  // Root tasks from run(), taken by any worker.
+  std::mutex injected_mutex_;
+  std::deque<HandleIdAndState*> injected_;
+  std::atomic<bool> has_injected_{false};
+  // Idle workers wait for epoch_ to change (a futex on Linux).
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<uint32_t> sleepers_{0};
+  std::atomic<bool> stopping_{false};
+  std::vector<std::jthread> threads_;
+};
+
+}  // namespace asyncio
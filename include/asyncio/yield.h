@@ -0,0 +1,34 @@
+#pragma once
+
+#include <asyncio/event_loop.h>
+
+// std
+#include <coroutine>
+
+namespace asyncio {
+
+namespace detail {
+
+struct YieldAwaiter {
+  // NOLINTNEXTLINE(readability-convert-member-functions-to-static)
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> caller) const noexcept {
+    // At the end of the ready queue, so the caller goes on in the next
+    // iteration of the loop, after IO and timers are checked.
+    get_event_loop().set_handle_will_be_called_soon(caller.promise());
+  }
+
+  constexpr void await_resume() const noexcept {}
+};
+
+}  // namespace detail
+
+// Let the other ready tasks, IO and timers go first, e.g. in a long loop which
+// never suspends otherwise.
+[[nodiscard("should use co_await")]] inline auto yield() {
+  return detail::YieldAwaiter{};
+}
+
+}  // namespace asyncio
@@ -1,14 +1,53 @@
 #include <asyncio/event_loop.h>
 #include <asyncio/handle.h>
+#include <asyncio/thread_pool.h>
+#include <asyncio/utils/frame_pool.h>
 
 namespace asyncio {
 
 EventLoop& get_event_loop() {
-  static EventLoop loop;
+  // Each thread has its own event loop. Its frame pool is made first, so that
+  // it is destroyed last: the loop frees the frames of the spawned tasks left.
+  [[maybe_unused]] thread_local FramePool& pool = get_frame_pool();
+  thread_local EventLoop loop;
   return loop;
 }
 
-HandleId HandleIdAndState::handle_id_generation_ = 0;
+FramePool& get_frame_pool() {
+  thread_local FramePool pool;
+  return pool;
+}
+
+ThreadPool& get_default_executor() {
+  // Shared by the loops of all threads.
+  static ThreadPool pool;
+  return pool;
+}
+
+std::atomic<HandleId> HandleIdAndState::handle_id_generation_ = 0;
+
+HandleId HandleIdAndState::next_handle_id() noexcept {
+  constexpr HandleId kBlockSize = 1024;
+  thread_local HandleId next_id = 0;
+  thread_local HandleId end_id = 0;
+  if (next_id == end_id) [[unlikely]] {
+    next_id = handle_id_generation_.fetch_add(kBlockSize,
+                                              std::memory_order_relaxed);
+    end_id = next_id + kBlockSize;
+  }
+  return next_id++;
+}
+
+HandleIdAndState::~HandleIdAndState() {
+#ifdef USE_SLOW_CALLBACK_CHECK
+  if (running_) {
+    get_event_loop().running_handle_destroyed();
+  }
+#endif
+  if (state_ == State::SCHEDULED) {
+    loop_->set_handle_cancelled(*this);
+  }
+}
 
 void CoHandleManager::schedule() {
   if (state_ == HandleIdAndState::State::UNSCHEDULED) {
@@ -18,7 +57,7 @@ void CoHandleManager::schedule() {
 
 void CoHandleManager::set_cancelled() {
   if (state_ == HandleIdAndState::State::SCHEDULED) {
-    get_event_loop().set_handle_cancelled(*this);
+    loop()->set_handle_cancelled(*this);
   }
 }
 
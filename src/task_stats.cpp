@@ -0,0 +1,114 @@
+#ifdef USE_TASK_STATS
+
+#include <asyncio/task_stats.h>
+#include <asyncio/utils/coroutine_name.h>
+
+// std
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace asyncio {
+
+namespace {
+
+// Stats of the tasks destroyed on a thread. Only that thread adds to them,
+// the lock is for get_task_stats() and reset_task_stats().
+struct ThreadTaskStats {
+  struct Entry {
+    std::string_view file;
+    TaskStats stats;
+  };
+
+  std::mutex mutex;
+  // By function_name() of std::source_location, which has static storage.
+  std::unordered_map<std::string_view, Entry> entries;
+};
+
+struct TaskStatsRegistry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadTaskStats>> threads;
+};
+
+TaskStatsRegistry& get_task_stats_registry() {
+  static TaskStatsRegistry registry;
+  return registry;
+}
+
+// Kept after the thread exits, so that its tasks are still counted.
+ThreadTaskStats& get_thread_task_stats() {
+  thread_local std::shared_ptr<ThreadTaskStats> stats = [] {
+    auto& registry = get_task_stats_registry();
+    std::lock_guard lock(registry.mutex);
+    return registry.threads.emplace_back(std::make_shared<ThreadTaskStats>());
+  }();
+  return *stats;
+}
+
+std::vector<std::shared_ptr<ThreadTaskStats>> get_all_task_stats() {
+  auto& registry = get_task_stats_registry();
+  std::lock_guard lock(registry.mutex);
+  return registry.threads;
+}
+
+}  // namespace
+
+namespace detail {
+
+void TaskClock::flush(const std::source_location& where) const noexcept {
+  auto& thread_stats = get_thread_task_stats();
+  std::lock_guard lock(thread_stats.mutex);
+  auto& entry = thread_stats.entries[where.function_name()];
+  entry.file = where.file_name();
+  entry.stats += {.tasks = 1,
+                  .resumes = resumes_,
+                  .running = std::chrono::nanoseconds(running_ns_),
+                  .ready_wait = std::chrono::nanoseconds(ready_wait_ns_),
+                  .io_wait = std::chrono::nanoseconds(io_wait_ns_)};
+}
+
+}  // namespace detail
+
+std::vector<TaskStatsEntry> get_task_stats() {
+  // The same function from different threads is merged.
+  std::map<std::string_view, TaskStatsEntry> merged;
+  for (auto& thread_stats : get_all_task_stats()) {
+    std::lock_guard lock(thread_stats->mutex);
+    for (const auto& [function, entry] : thread_stats->entries) {
+      auto name = detail::coroutine_name(function);
+      auto& total = merged[name];
+      if (total.function.empty()) {
+        total.function = name;
+        total.file = entry.file;
+      }
+      total.stats += entry.stats;
+    }
+  }
+  std::vector<TaskStatsEntry> stats;
+  stats.reserve(merged.size());
+  for (auto& [_, entry] : merged) {
+    stats.push_back(std::move(entry));
+  }
+  std::stable_sort(stats.begin(), stats.end(),
+                   [](const auto& a, const auto& b) {
+                     return a.stats.running > b.stats.running;
+                   });
+  return stats;
+}
+
+void reset_task_stats() {
+  for (auto& thread_stats : get_all_task_stats()) {
+    std::lock_guard lock(thread_stats->mutex);
+    thread_stats->entries.clear();
+  }
+}
+
+}  // namespace asyncio
+
+#endif
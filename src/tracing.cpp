@@ -0,0 +1,185 @@
+#ifdef USE_TRACING
+
+#include <asyncio/tracing.h>
+#include <asyncio/utils/coroutine_name.h>
+
+// 3rd
+#include <fmt/core.h>
+
+// std
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace asyncio {
+
+namespace {
+
+struct TraceRegistry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+};
+
+TraceRegistry& get_trace_registry() {
+  static TraceRegistry registry;
+  return registry;
+}
+
+std::string json_string(std::string_view text) {
+  std::string out = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out += fmt::format("\\u{:04x}", static_cast<int>(c));
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+  return out;
+}
+
+std::string location(const std::source_location& where) {
+  if (where.line() == 0) {
+    return "?";
+  }
+  return fmt::format("{}:{}", where.file_name(), where.line());
+}
+
+// Chrome traces are in microseconds.
+std::string micros(int64_t ns) { return fmt::format("{:.3f}", ns / 1000.0); }
+
+class ChromeTraceWriter {
+ public:
+  explicit ChromeTraceWriter(std::ostream& out) : out_(out) {
+    out_ << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  }
+
+  ~ChromeTraceWriter() { out_ << "\n]}\n"; }
+
+  void write(std::string_view fields) {
+    out_ << (first_ ? "\n" : ",\n") << '{' << fields << '}';
+    first_ = false;
+  }
+
+ private:
+  std::ostream& out_;
+  bool first_ = true;
+};
+
+}  // namespace
+
+TraceBuffer& get_trace_buffer() {
+  thread_local std::shared_ptr<TraceBuffer> buffer = [] {
+    auto& registry = get_trace_registry();
+    std::lock_guard lock(registry.mutex);
+    auto& buffer = registry.buffers.emplace_back(
+        std::make_shared<TraceBuffer>(registry.buffers.size()));
+    return buffer;
+  }();
+  return *buffer;
+}
+
+void dump_chrome_trace(std::ostream& out) {
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+  {
+    auto& registry = get_trace_registry();
+    std::lock_guard lock(registry.mutex);
+    buffers = registry.buffers;
+  }
+  std::vector<std::vector<TraceEvent>> events_by_thread;
+  events_by_thread.reserve(buffers.size());
+  // A Task is named by the function of any of its co_awaits.
+  std::unordered_map<HandleId, std::string_view> names;
+  for (auto& buffer : buffers) {
+    auto& events = events_by_thread.emplace_back(buffer->snapshot());
+    for (const auto& event : events) {
+      if (event.where.line() != 0) {
+        names.try_emplace(event.id,
+                          detail::coroutine_name(event.where.function_name()));
+      }
+    }
+  }
+  auto name_of = [&names](HandleId id) {
+    auto it = names.find(id);
+    return it != names.end() ? json_string(it->second)
+                             : json_string(fmt::format("task {}", id));
+  };
+
+  ChromeTraceWriter writer(out);
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    size_t tid = buffers[i]->thread_index();
+    writer.write(fmt::format(
+        R"("ph":"M","name":"thread_name","pid":1,"tid":{},"args":{{"name":"thread {}"}})",
+        tid, tid));
+    // Tasks running on this thread, nested when a Task runs another one
+    // without suspending, e.g. with ResumeAtInitialSuspend.
+    std::vector<const TraceEvent*> running;
+    std::unordered_map<HandleId, const TraceEvent*> last_suspend;
+    for (const auto& event : events_by_thread[i]) {
+      switch (event.type) {
+        case TraceEventType::CREATE:
+        case TraceEventType::SCHEDULE:
+          writer.write(fmt::format(
+              R"("ph":"i","s":"t","name":"{}","pid":1,"tid":{},"ts":{},"args":{{"id":{},"task":{}}})",
+              event.type == TraceEventType::CREATE ? "create" : "schedule",
+              tid, micros(event.time_ns), event.id, name_of(event.id)));
+          break;
+        case TraceEventType::RESUME:
+          running.push_back(&event);
+          break;
+        case TraceEventType::SUSPEND:
+        case TraceEventType::COMPLETE: {
+          if (event.type == TraceEventType::SUSPEND) {
+            last_suspend[event.id] = &event;
+          }
+          // Its RESUME may have been overwritten in the ring.
+          auto it = std::find_if(
+              running.rbegin(), running.rend(),
+              [&event](const TraceEvent* e) { return e->id == event.id; });
+          if (it == running.rend()) {
+            break;
+          }
+          const TraceEvent& resume = **it;
+          running.erase(std::prev(it.base()), running.end());
+          writer.write(fmt::format(
+              R"("ph":"X","name":{},"pid":1,"tid":{},"ts":{},"dur":{},"args":{{"id":{},"resumed_at":{},"{}":{}}})",
+              name_of(event.id), tid, micros(resume.time_ns),
+              micros(event.time_ns - resume.time_ns), event.id,
+              json_string(location(resume.where)),
+              event.type == TraceEventType::SUSPEND ? "suspended_at"
+                                                    : "completed_after",
+              json_string(location(event.where))));
+          break;
+        }
+        case TraceEventType::IO_WAIT:
+        case TraceEventType::IO_READY: {
+          // The co_await waiting for IO is the last one suspended.
+          std::string name = "io wait";
+          if (auto it = last_suspend.find(event.id); it != last_suspend.end()) {
+            name += " at " + location(it->second->where);
+          }
+          writer.write(fmt::format(
+              R"("ph":"{}","cat":"io","name":{},"id":{},"pid":1,"tid":{},"ts":{},"args":{{"task":{}}})",
+              event.type == TraceEventType::IO_WAIT ? "b" : "e",
+              json_string(name), event.id, tid, micros(event.time_ns),
+              name_of(event.id)));
+          break;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace asyncio
+
+#endif
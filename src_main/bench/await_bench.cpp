@@ -0,0 +1,65 @@
+// Cost of co_await on a Task, through the ready queue, or resumed directly
+// when built with WITH_SYMMETRIC_TRANSFER:
+// - deep chain: each task awaits the next one, n layers deep.
+// - flat loop: one task awaits n tasks one after another.
+
+#include <asyncio/asyncio.h>
+
+// 3rd
+#include <fmt/core.h>
+
+// std
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+
+using namespace asyncio;
+
+namespace {
+
+Task<size_t> depth(size_t n) {
+  if (n == 0) {
+    co_return 0;
+  }
+  co_return co_await depth(n - 1) + 1;
+}
+
+Task<size_t> one() { co_return 1; }
+
+Task<size_t> flat(size_t n) {
+  size_t sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += co_await one();
+  }
+  co_return sum;
+}
+
+// Returns ns per awaited task.
+template <typename MakeTask>
+double bench(size_t n, size_t rounds, MakeTask make_task) {
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    if (size_t result = asyncio::run(make_task(n)); result != n) {
+      fmt::print(stderr, "got {}, expected {}\n", result, n);
+      std::exit(1);
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count() / static_cast<double>(n * rounds);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000;
+  size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100;
+#ifdef USE_SYMMETRIC_TRANSFER
+  const char* mode = "symmetric transfer";
+#else
+  const char* mode = "ready queue";
+#endif
+  fmt::print("{} awaits x {} rounds, {}, ns per await\n", n, rounds, mode);
+  fmt::print("deep chain {:6.1f} ns\n", bench(n, rounds, depth));
+  fmt::print("flat loop  {:6.1f} ns\n", bench(n, rounds, flat));
+}
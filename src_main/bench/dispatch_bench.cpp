@@ -0,0 +1,93 @@
+// Throughput of the ready queue of EventLoop: schedule handles soon, cancel
+// some of them, and run the loop until all the others have run. Scattered
+// handles are allocated one by one, as large as a small coroutine frame, and
+// scheduled in random order.
+
+#include <asyncio/asyncio.h>
+
+// 3rd
+#include <fmt/core.h>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace asyncio;
+
+namespace {
+
+struct CountHandle : HandleIdAndState {
+  void run() final { ++*count; }
+
+  size_t* count = nullptr;
+};
+
+struct FrameSizedHandle : CountHandle {
+  char frame[256];
+};
+
+// Returns ns per scheduled handle.
+double bench(size_t n_handles, size_t rounds, size_t cancel_every,
+             bool scattered = false) {
+  auto& loop = get_event_loop();
+  size_t count = 0;
+  std::vector<std::unique_ptr<CountHandle>> owned;
+  auto contiguous = std::make_unique<CountHandle[]>(scattered ? 0 : n_handles);
+  std::vector<CountHandle*> handles(n_handles);
+  for (size_t i = 0; i < n_handles; ++i) {
+    if (scattered) {
+      handles[i] = owned.emplace_back(new FrameSizedHandle).get();
+    } else {
+      handles[i] = &contiguous[i];
+    }
+    handles[i]->count = &count;
+  }
+  if (scattered) {
+    std::shuffle(handles.begin(), handles.end(), std::mt19937_64(42));
+  }
+
+  size_t expected = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    for (size_t i = 0; i < n_handles; ++i) {
+      loop.set_handle_will_be_called_soon(*handles[i]);
+    }
+    if (cancel_every != 0) {
+      for (size_t i = 0; i < n_handles; i += cancel_every) {
+        loop.set_handle_cancelled(*handles[i]);
+      }
+    }
+    loop.run_until_complete();
+    expected += n_handles - (cancel_every != 0
+                                 ? (n_handles + cancel_every - 1) / cancel_every
+                                 : 0);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  if (count != expected) {
+    fmt::print(stderr, "{} handles run, expected {}\n", count, expected);
+    std::exit(1);
+  }
+  return elapsed.count() / static_cast<double>(n_handles * rounds);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t n_handles = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000;
+  size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100;
+  fmt::print("{} handles x {} rounds, ns per handle\n", n_handles, rounds);
+  fmt::print("dispatch                {:6.1f} ns\n",
+             bench(n_handles, rounds, 0));
+  fmt::print("dispatch, 1/4 cancelled {:6.1f} ns\n",
+             bench(n_handles, rounds, 4));
+  fmt::print("dispatch, scattered     {:6.1f} ns\n",
+             bench(n_handles, rounds, 0, true));
+  fmt::print("max ready queue size    {:6}\n",
+             get_event_loop().max_ready_queue_size());
+}
@@ -0,0 +1,113 @@
+// Scaling of WorkStealingScheduler with CPU-bound tasks, from 1 to 64 worker
+// threads. Each task splits its work in two with gather() down to a cutoff,
+// below which it computes serially:
+// - fib: naive Fibonacci, an unbalanced tree of tasks.
+// - tree sum: sum of the values of a balanced binary tree in memory.
+
+#include <asyncio/asyncio.h>
+
+// 3rd
+#include <fmt/core.h>
+
+// std
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+using namespace asyncio;
+
+namespace {
+
+uint64_t serial_fib(int n) {
+  return n < 2 ? n : serial_fib(n - 1) + serial_fib(n - 2);
+}
+
+Task<uint64_t> fib(int n, int cutoff) {
+  if (n <= cutoff) {
+    co_return serial_fib(n);
+  }
+  auto [a, b] = co_await gather(fib(n - 1, cutoff), fib(n - 2, cutoff));
+  co_return a + b;
+}
+
+struct Node {
+  uint64_t value;
+  std::unique_ptr<Node> left;
+  std::unique_ptr<Node> right;
+};
+
+std::unique_ptr<Node> make_tree(int depth, uint64_t& next) {
+  auto node = std::make_unique<Node>(Node{.value = next++});
+  if (depth > 0) {
+    node->left = make_tree(depth - 1, next);
+    node->right = make_tree(depth - 1, next);
+  }
+  return node;
+}
+
+uint64_t serial_sum(const Node* node) {
+  return node == nullptr
+             ? 0
+             : node->value + serial_sum(node->left.get()) +
+                   serial_sum(node->right.get());
+}
+
+Task<uint64_t> tree_sum(const Node* node, int depth, int cutoff) {
+  if (depth <= cutoff) {
+    co_return serial_sum(node);
+  }
+  auto [a, b] = co_await gather(tree_sum(node->left.get(), depth - 1, cutoff),
+                                tree_sum(node->right.get(), depth - 1, cutoff));
+  co_return node->value + a + b;
+}
+
+template <typename MakeTask>
+double bench_ms(size_t n_threads, uint64_t expected, MakeTask make_task) {
+  WorkStealingScheduler scheduler(n_threads);
+  auto begin = std::chrono::steady_clock::now();
+  uint64_t result = scheduler.run(make_task());
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  if (result != expected) {
+    fmt::print(stderr, "got {}, expected {}\n", result, expected);
+    std::exit(1);
+  }
+  return elapsed.count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int fib_n = argc > 1 ? std::atoi(argv[1]) : 36;
+  int tree_depth = argc > 2 ? std::atoi(argv[2]) : 22;
+  // Leaves of about 10us of work.
+  constexpr int kFibCutoff = 18;
+  constexpr int kTreeCutoff = 10;
+
+  uint64_t fib_expected = serial_fib(fib_n);
+  uint64_t next = 0;
+  auto tree = make_tree(tree_depth, next);
+  uint64_t tree_expected = serial_sum(tree.get());
+
+  fmt::print("fib({}) and sum of a tree of depth {}, {} hardware threads\n",
+             fib_n, tree_depth, std::thread::hardware_concurrency());
+  fmt::print("threads  fib ms  speedup  tree ms  speedup\n");
+  double fib_base = 0;
+  double tree_base = 0;
+  for (size_t n_threads = 1; n_threads <= 64; n_threads *= 2) {
+    double fib_ms = bench_ms(n_threads, fib_expected,
+                             [&] { return fib(fib_n, kFibCutoff); });
+    double tree_ms = bench_ms(n_threads, tree_expected, [&] {
+      return tree_sum(tree.get(), tree_depth, kTreeCutoff);
+    });
+    if (n_threads == 1) {
+      fib_base = fib_ms;
+      tree_base = tree_ms;
+    }
+    fmt::print("{:7}  {:6.1f}  {:6.2f}x  {:7.1f}  {:6.2f}x\n", n_threads,
+               fib_ms, fib_base / fib_ms, tree_ms, tree_base / tree_ms);
+  }
+}
@@ -0,0 +1,130 @@
+// Cost of IO wakeups of EventLoop while many idle fds are registered.
+//
+// Each idle fd has a coroutine waiting to read from it, so it's in the
+// interest list of the selector, but nothing is written to it until the end.
+// A few active pairs of coroutines ping-pong one byte over two pipes, every
+// read waits for the selector.
+
+#include <asyncio/asyncio.h>
+#include <asyncio/io/stream.h>
+
+// 3rd
+#include <fmt/core.h>
+
+// std
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+// sys
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace asyncio;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct Pipe {
+  Stream reader;
+  Stream writer;
+};
+
+Pipe make_pipe() {
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK) != 0) {
+    perror("pipe2");
+    std::exit(1);
+  }
+  return {Stream{fds[0]}, Stream{fds[1]}};
+}
+
+Task<> read_one(Stream& in) {
+  char c;
+  co_await in.async_read_some({&c, 1});
+}
+
+Task<> ping(Pipe& out, Pipe& in, size_t rounds) {
+  char c = 'x';
+  for (size_t i = 0; i < rounds; ++i) {
+    co_await out.writer.async_write_some({&c, 1});
+    co_await in.reader.async_read_some({&c, 1});
+  }
+}
+
+Task<> pong(Pipe& in, Pipe& out, size_t rounds) {
+  char c;
+  for (size_t i = 0; i < rounds; ++i) {
+    co_await in.reader.async_read_some({&c, 1});
+    co_await out.writer.async_write_some({&c, 1});
+  }
+}
+
+// Returns ns per round trip.
+Task<double> bench(size_t n_idle, size_t n_active, size_t rounds) {
+  std::vector<Pipe> idle;
+  idle.reserve(n_idle);
+  std::vector<ScheduledTask<Task<>>> idle_tasks;
+  idle_tasks.reserve(n_idle);
+  for (size_t i = 0; i < n_idle; ++i) {
+    idle.push_back(make_pipe());
+    idle_tasks.push_back(create_scheduled_task(read_one(idle.back().reader)));
+  }
+  // Let all idle readers wait for their fds.
+  co_await sleep_for(1ms);
+
+  std::vector<Pipe> active;
+  active.reserve(n_active * 2);
+  std::vector<ScheduledTask<Task<>>> active_tasks;
+  active_tasks.reserve(n_active * 2);
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n_active; ++i) {
+    auto& a = active.emplace_back(make_pipe());
+    auto& b = active.emplace_back(make_pipe());
+    active_tasks.push_back(create_scheduled_task(ping(a, b, rounds)));
+    active_tasks.push_back(create_scheduled_task(pong(a, b, rounds)));
+  }
+  for (auto& task : active_tasks) {
+    co_await task;
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+
+  char c = 'x';
+  for (auto& pipe : idle) {
+    co_await pipe.writer.async_write_some({&c, 1});
+  }
+  for (auto& task : idle_tasks) {
+    co_await task;
+  }
+  co_return elapsed.count() / static_cast<double>(n_active * rounds);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t n_idle = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000;
+  size_t n_active = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4;
+  size_t rounds = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 20'000;
+
+  // Every pipe needs two fds.
+  rlimit limit{};
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  if (rlim_t needed = (n_idle + n_active * 2) * 2 + 16;
+      limit.rlim_cur < needed) {
+    fmt::print(stderr, "need {} fds, but RLIMIT_NOFILE is {}\n", needed,
+               limit.rlim_cur);
+    return 1;
+  }
+
+  fmt::print("{} active pairs x {} rounds, ns per round trip\n", n_active,
+             rounds);
+  fmt::print("no idle fds      {:8.1f} ns\n",
+             asyncio::run(bench(0, n_active, rounds)));
+  fmt::print("{:<7} idle fds {:8.1f} ns\n", n_idle,
+             asyncio::run(bench(n_idle, n_active, rounds)));
+}
@@ -0,0 +1,100 @@
+// Compare the timer queues of EventLoop with 1M live timers.
+//
+// insert:  add all timers, deadlines spread over 60s
+// cancel:  remove half of them, like timeouts of requests that finished
+// expire:  advance the time 1ms at a time until all the others fired
+// churn:   with all timers live, insert a timer and cancel it again
+
+#include <asyncio/timer/timer_heap.h>
+#include <asyncio/timer/timing_wheel.h>
+
+// 3rd
+#include <fmt/core.h>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace asyncio;
+using MSDuration = std::chrono::milliseconds;
+
+namespace {
+
+template <typename F>
+double ns_per_op(size_t n, F&& f) {
+  auto begin = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count() / static_cast<double>(n);
+}
+
+template <typename TimerQueue>
+void bench(const char* name, size_t n_timers) {
+  std::mt19937_64 gen(42);
+  std::uniform_int_distribution<int64_t> dist(1, 60'000);
+  std::vector<MSDuration> deadlines(n_timers);
+  for (auto& when : deadlines) {
+    when = MSDuration(dist(gen));
+  }
+  std::vector<size_t> order(n_timers);
+  for (size_t i = 0; i < n_timers; ++i) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), gen);
+
+  auto timers = std::make_unique<TimerQueue>();
+  auto entries = std::make_unique<TimerEntry[]>(n_timers);
+
+  double insert = ns_per_op(n_timers, [&] {
+    for (size_t i = 0; i < n_timers; ++i) {
+      timers->insert(entries[i], deadlines[i]);
+    }
+  });
+
+  constexpr size_t kChurn = 1'000'000;
+  TimerEntry extra;
+  double churn = ns_per_op(kChurn, [&] {
+    for (size_t i = 0; i < kChurn; ++i) {
+      timers->insert(extra, deadlines[i % n_timers]);
+      timers->erase(extra);
+    }
+  });
+
+  size_t n_cancel = n_timers / 2;
+  double cancel = ns_per_op(n_cancel, [&] {
+    for (size_t i = 0; i < n_cancel; ++i) {
+      timers->erase(entries[order[i]]);
+    }
+  });
+
+  size_t fired = 0;
+  double expire = ns_per_op(n_timers - n_cancel, [&] {
+    for (MSDuration now{0}; !timers->empty(); now += MSDuration(1)) {
+      timers->expire(now, [&](TimerEntry&) { ++fired; });
+    }
+  });
+  if (fired != n_timers - n_cancel) {
+    fmt::print(stderr, "{}: {} timers fired, expected {}\n", name, fired,
+               n_timers - n_cancel);
+    std::exit(1);
+  }
+
+  fmt::print("{:<12} insert {:7.1f} ns  cancel {:7.1f} ns  expire {:7.1f} ns  "
+             "churn {:7.1f} ns\n",
+             name, insert, cancel, expire, churn);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t n_timers = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  fmt::print("{} live timers, ns per timer\n", n_timers);
+  bench<TimerHeap>("TimerHeap", n_timers);
+  bench<TimingWheel>("TimingWheel", n_timers);
+}
@@ -5,10 +5,27 @@
 #include <catch2/catch_test_macros.hpp>
 
 // std
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
+#ifndef NO_IO
+// sys
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 using namespace asyncio;
 using namespace std::chrono_literals;
 
@@ -96,6 +113,17 @@ SCENARIO("test Task await result value") {
     REQUIRE(asyncio::run(fib(2)) == 1);
     REQUIRE(asyncio::run(fib(12)) == 144);
   }
+
+  GIVEN("deep await chain") {
+    std::function<auto(size_t)->Task<size_t>> depth =
+        [&](size_t n) -> Task<size_t> {
+      if (n == 0) {
+        co_return 0;
+      }
+      co_return co_await depth(n - 1) + 1;
+    };
+    REQUIRE(asyncio::run(depth(100'000)) == 100'000);
+  }
 }
 
 SCENARIO("test Task for loop") {
@@ -185,6 +213,19 @@ SCENARIO("test sleep") {
     REQUIRE(call_time == 2);
   }
 
+  GIVEN("sleep_for without a Task") {
+    const auto& stats = get_frame_pool().stats();
+    size_t frames = 0;
+    auto before_wait = get_event_loop().time();
+    asyncio::run([&]() -> Task<> {
+      frames = stats.hits + stats.misses;
+      co_await asyncio::sleep_for(50ms);
+      frames = stats.hits + stats.misses - frames;
+    }());
+    REQUIRE(get_event_loop().time() - before_wait >= 50ms);
+    REQUIRE(frames == 0);
+  }
+
   GIVEN("schedule sleep and cancel") {
     auto async_main = [&]() -> Task<> {
       auto task1 = create_scheduled_task(say_after(100ms, "hello"));
@@ -222,6 +263,317 @@ SCENARIO("test sleep") {
   }
 }
 
+SCENARIO("destroy scheduled handles") {
+  struct CountHandle : HandleIdAndState {
+    void run() final { ++count; }
+    int count = 0;
+  };
+  auto& loop = get_event_loop();
+  CountHandle kept;
+  auto ready = std::make_unique<CountHandle>();
+  auto delayed = std::make_unique<CountHandle>();
+  loop.set_handle_will_be_called_soon(*ready);
+  loop.set_handle_will_be_called_soon(kept);
+  loop.call_later(1h, *delayed);
+  // A destroyed handle leaves the queues, so the loop neither runs it nor
+  // waits for it.
+  ready.reset();
+  delayed.reset();
+  loop.run_until_complete();
+  REQUIRE(kept.count == 1);
+
+  // Scheduling a handle twice runs it once.
+  loop.set_handle_will_be_called_soon(kept);
+  loop.set_handle_will_be_called_soon(kept);
+  loop.run_until_complete();
+  REQUIRE(kept.count == 2);
+
+  // Handles destroyed by another thread leave the loop which scheduled them.
+  auto other_ready = std::make_unique<CountHandle>();
+  auto other_delayed = std::make_unique<CountHandle>();
+  int other_kept_count = 0;
+  std::latch scheduled(1);
+  std::latch destroyed(1);
+  std::thread thread([&] {
+    auto& other_loop = get_event_loop();
+    CountHandle other_kept;
+    other_loop.set_handle_will_be_called_soon(*other_ready);
+    other_loop.set_handle_will_be_called_soon(other_kept);
+    other_loop.call_later(1h, *other_delayed);
+    scheduled.count_down();
+    destroyed.wait();
+    other_loop.run_until_complete();
+    other_kept_count = other_kept.count;
+  });
+  scheduled.wait();
+  other_ready.reset();
+  other_delayed.reset();
+  destroyed.count_down();
+  thread.join();
+  REQUIRE(other_kept_count == 1);
+}
+
+SCENARIO("ready queue order") {
+  struct OrderHandle : HandleIdAndState {
+    // Schedule itself again until it has run `rounds` times.
+    void run() final {
+      order->push_back(id);
+      if (--rounds > 0) {
+        get_event_loop().set_handle_will_be_called_soon(*this);
+      }
+    }
+    std::vector<int>* order = nullptr;
+    int id = 0;
+    int rounds = 3;
+  };
+  auto& loop = get_event_loop();
+  constexpr int kHandles = 100;
+  std::vector<int> order;
+  std::vector<OrderHandle> handles(kHandles);
+  for (int i = 0; i < kHandles; ++i) {
+    handles[i].order = &order;
+    handles[i].id = i;
+    loop.set_handle_will_be_called_soon(handles[i]);
+  }
+  for (int i = 0; i < kHandles; i += 3) {
+    loop.set_handle_cancelled(handles[i]);
+  }
+  // The queue wraps around while the handles schedule themselves again.
+  loop.run_until_complete();
+  std::vector<int> expected;
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < kHandles; ++i) {
+      if (i % 3 != 0) {
+        expected.push_back(i);
+      }
+    }
+  }
+  REQUIRE(order == expected);
+  REQUIRE(loop.max_ready_queue_size() >= kHandles);
+}
+
+SCENARIO("ready queue priorities") {
+  std::vector<std::string> order;
+  auto record = [&order](std::string name) -> Task<> {
+    order.push_back(std::move(name));
+    co_return;
+  };
+
+  GIVEN("tasks of each priority") {
+    asyncio::run([&]() -> Task<> {
+      auto background = create_scheduled_task(record("background"),
+                                              Priority::BACKGROUND);
+      auto normal = create_scheduled_task(record("normal"));
+      auto high = create_scheduled_task(record("high"), Priority::HIGH);
+      co_await background;
+      co_await normal;
+      co_await high;
+    }());
+    REQUIRE(order == std::vector<std::string>{"high", "normal", "background"});
+  }
+
+  GIVEN("a task created by a high one") {
+    auto high_task = [&]() -> Task<> {
+      order.push_back("high");
+      // Also HIGH, so it runs before normal, in the same iteration.
+      auto child = create_scheduled_task(record("child"));
+      co_await child;
+    };
+    asyncio::run([&]() -> Task<> {
+      auto normal = create_scheduled_task(record("normal"));
+      auto high = create_scheduled_task(high_task(), Priority::HIGH);
+      co_await normal;
+      co_await high;
+    }());
+    REQUIRE(order == std::vector<std::string>{"high", "child", "normal"});
+  }
+
+  GIVEN("a task which yielded before it is given a priority") {
+    auto yielding = [&](ResumeAtInitialSuspend) -> Task<> {
+      co_await asyncio::yield();
+      order.push_back("yielded");
+    };
+    asyncio::run([&]() -> Task<> {
+      {
+        // It keeps its place in the NORMAL queue, and leaves it when it is
+        // destroyed.
+        auto task = create_scheduled_task(yielding(resume_at_initial_suspend),
+                                          Priority::HIGH);
+      }
+      co_await record("after");
+    }());
+    REQUIRE(order == std::vector<std::string>{"after"});
+  }
+
+  GIVEN("busy tasks of higher priority") {
+    auto& loop = get_event_loop();
+    struct BusyHandle : HandleIdAndState {
+      // Schedule itself again until stop.
+      void run() final {
+        ++runs;
+        if (!*stop) {
+          get_event_loop().set_handle_will_be_called_soon(*this);
+        }
+      }
+      bool* stop = nullptr;
+      size_t runs = 0;
+    };
+    bool stop = false;
+    std::vector<BusyHandle> high(1), normal(100), background(1000);
+    for (auto [handles, priority] :
+         {std::pair{&high, Priority::HIGH},
+          std::pair{&normal, Priority::NORMAL},
+          std::pair{&background, Priority::BACKGROUND}}) {
+      for (auto& handle : *handles) {
+        handle.stop = &stop;
+        handle.set_priority(priority);
+        loop.set_handle_will_be_called_soon(handle);
+      }
+    }
+    // The background handles aren't starved, but run less often.
+    asyncio::run([&]() -> Task<> {
+      while (background.back().runs < 3) {
+        co_await asyncio::sleep(0ms);
+      }
+      stop = true;
+    }());
+    REQUIRE(normal.front().runs > background.front().runs);
+    // Before each lower one, as it is always ready.
+    REQUIRE(high[0].runs > normal.front().runs * normal.size());
+  }
+}
+
+SCENARIO("yield to the other ready tasks") {
+  std::vector<std::string> order;
+  auto busy = [&order](std::string name) -> Task<> {
+    for (int i = 0; i < 3; ++i) {
+      order.push_back(name + std::to_string(i));
+      co_await asyncio::yield();
+    }
+  };
+  asyncio::run([&]() -> Task<> {
+    auto a = create_scheduled_task(busy("a"));
+    auto b = create_scheduled_task(busy("b"));
+    co_await a;
+    co_await b;
+  }());
+  REQUIRE(order ==
+          std::vector<std::string>{"a0", "b0", "a1", "b1", "a2", "b2"});
+}
+
+#ifdef USE_METRICS
+SCENARIO("loop metrics") {
+  GIVEN("a histogram") {
+    Histogram histogram;
+    for (uint64_t i = 1; i <= 1000; ++i) {
+      histogram.record(i);
+    }
+    auto snapshot = histogram.snapshot();
+    REQUIRE(snapshot.count == 1000);
+    REQUIRE(snapshot.max == 1000);
+    REQUIRE(snapshot.mean() == Catch::Approx(500.5));
+    REQUIRE(snapshot.percentile(100) == 1000);
+    REQUIRE(snapshot.percentile(0) == 1);
+    // Within 1/16 of the exact value.
+    REQUIRE(snapshot.percentile(50) >= 500);
+    REQUIRE(snapshot.percentile(50) <= 500 + 500 / 16);
+    for (uint64_t value : {0, 15, 16, 17, 1000, 123'456'789}) {
+      auto bucket = Histogram::bucket_of(value);
+      REQUIRE(Histogram::bucket_value(bucket) <= value);
+      REQUIRE(Histogram::bucket_value(bucket + 1) > value);
+    }
+    REQUIRE(Histogram::bucket_of(UINT64_MAX) == Histogram::kBuckets - 1);
+  }
+
+  GIVEN("a loop snapshotted by another thread") {
+    auto& loop = get_event_loop();
+    auto before = loop.metrics().snapshot();
+    std::atomic<bool> running = true;
+    std::vector<uint64_t> iterations;
+    std::jthread observer([&] {
+      while (running) {
+        iterations.push_back(loop.metrics().snapshot().iterations);
+        std::this_thread::sleep_for(1ms);
+      }
+    });
+    asyncio::run([&]() -> Task<> {
+      for (int i = 0; i < 5; ++i) {
+        co_await asyncio::sleep(5ms);
+      }
+      co_await square(3);
+      loop.call_soon_threadsafe([] {});
+      co_await asyncio::sleep(1ms);
+    }());
+    running = false;
+    observer.join();
+    auto after = loop.metrics().snapshot();
+
+    REQUIRE(std::is_sorted(iterations.begin(), iterations.end()));
+    REQUIRE(after.iterations > before.iterations);
+    REQUIRE(after.timers_fired == before.timers_fired + 6);
+    REQUIRE(after.timer_lag_ns.count == before.timer_lag_ns.count + 6);
+    REQUIRE(after.threadsafe_calls == before.threadsafe_calls + 1);
+    REQUIRE(after.handles_run > before.handles_run + 6);
+    REQUIRE(after.iteration_ns.count == after.iterations);
+    REQUIRE(after.ready_batch.count == after.iterations);
+    REQUIRE(after.timers == 0);
+    REQUIRE(after.ready_queue_size == 0);
+  }
+}
+#endif
+
+#ifdef USE_SLOW_CALLBACK_CHECK
+Task<> block_loop(std::chrono::milliseconds duration) {
+  std::this_thread::sleep_for(duration);
+  co_await asyncio::sleep(0ms);
+}
+
+SCENARIO("report slow callbacks") {
+  auto& loop = get_event_loop();
+  std::vector<SlowCallback> reports;
+  loop.set_slow_callback_duration(20ms);
+  loop.set_slow_callback_handler(
+      [&reports](const SlowCallback& slow) { reports.push_back(slow); });
+
+  GIVEN("a coroutine blocking the loop") {
+    asyncio::run([]() -> Task<> {
+      co_await asyncio::sleep(1ms);
+      co_await block_loop(30ms);
+    }());
+    auto slow = std::find_if(reports.begin(), reports.end(),
+                             [](const auto& r) { return r.duration >= 30ms; });
+    REQUIRE(slow != reports.end());
+    REQUIRE(slow->finished);
+    // Where it stopped after blocking, then where its parents wait.
+    REQUIRE(slow->backtrace.starts_with("[0] "));
+    REQUIRE(slow->backtrace.find(__FILE__) != std::string::npos);
+  }
+
+  GIVEN("a watchdog") {
+    std::mutex mutex;
+    std::vector<SlowCallback> stalls;
+    {
+      LoopWatchdog watchdog(loop, 10ms, [&](const SlowCallback& slow) {
+        std::lock_guard lock(mutex);
+        stalls.push_back(slow);
+      });
+      asyncio::run(block_loop(50ms));
+    }
+    // Once while it blocks, and once by the loop when it is done.
+    REQUIRE(stalls.size() == 1);
+    REQUIRE_FALSE(stalls[0].finished);
+    REQUIRE(stalls[0].duration >= 10ms);
+    REQUIRE(stalls[0].backtrace.empty());
+    REQUIRE(std::any_of(reports.begin(), reports.end(), [&](const auto& r) {
+      return r.id == stalls[0].id && r.finished;
+    }));
+  }
+
+  loop.set_slow_callback_duration(100ms);
+  loop.set_slow_callback_handler({});
+}
+#endif
+
 SCENARIO("cancel a infinite loop coroutine") {
   int count = 0;
   asyncio::run([&]() -> Task<> {
@@ -368,6 +720,49 @@ SCENARIO("test gather") {
     REQUIRE(is_called);
   }
 
+  SECTION("gather a range of tasks") {
+    asyncio::run([&]() -> Task<> {
+      std::vector<Task<int>> tasks;
+      for (int i = 1; i <= 4; ++i) {
+        tasks.push_back(factorial("V", i));
+      }
+      auto before_wait = get_event_loop().time();
+      auto results = co_await asyncio::gather(std::move(tasks));
+      REQUIRE(results == std::vector<int>{1, 2, 6, 24});
+      // Concurrently: as long as the longest one.
+      REQUIRE(get_event_loop().time() - before_wait < 0.4s);
+
+      const auto& stats = get_frame_pool().stats();
+      auto frames = stats.hits + stats.misses;
+      auto squares = co_await asyncio::gather(
+          std::views::iota(0, 100) |
+          std::views::transform([](int i) { return square(i); }));
+      // A frame per child and one for gather, none to collect the results.
+      REQUIRE(stats.hits + stats.misses - frames == 101);
+      REQUIRE(squares.size() == 100);
+      REQUIRE(squares[99] == 99 * 99);
+
+      std::vector<Task<>> voids;
+      voids.push_back(test_void_func());
+      auto void_values = co_await asyncio::gather(std::move(voids));
+      REQUIRE(void_values.size() == 1);
+      auto none = co_await asyncio::gather(std::vector<Task<int>>{});
+      REQUIRE(none.empty());
+      is_called = true;
+    }());
+    REQUIRE(is_called);
+  }
+
+  SECTION("exception in a range of tasks") {
+    asyncio::run([&]() -> Task<> {
+      std::vector<Task<double>> tasks;
+      tasks.push_back(int_div(4, 2));
+      tasks.push_back(int_div(4, 0));
+      REQUIRE_THROWS_AS(co_await asyncio::gather(std::move(tasks)),
+                        std::overflow_error);
+    }());
+  }
+
   SECTION("wait_for with gather") {
     REQUIRE(!is_called);
     asyncio::run([&]() -> Task<> {
@@ -383,8 +778,657 @@ SCENARIO("test gather") {
   }
 }
 
+SCENARIO("results as they complete") {
+  auto after = [](int ms) -> Task<int> {
+    co_await asyncio::sleep(ms * 1ms);
+    co_return ms;
+  };
+
+  GIVEN("tasks finishing in another order") {
+    std::vector<std::pair<size_t, int>> order;
+    asyncio::run([&]() -> Task<> {
+      std::vector<Task<int>> tasks;
+      for (int ms : {30, 10, 20}) {
+        tasks.push_back(after(ms));
+      }
+      auto completed = as_completed(std::move(tasks));
+      REQUIRE(completed.size() == 3);
+      while (!completed.empty()) {
+        order.push_back(co_await completed.next());
+      }
+    }());
+    REQUIRE(order ==
+            std::vector<std::pair<size_t, int>>{{1, 10}, {2, 20}, {0, 30}});
+  }
+
+  GIVEN("a task which throws") {
+    asyncio::run([&]() -> Task<> {
+      std::vector<Task<double>> tasks;
+      tasks.push_back(int_div(4, 0));
+      tasks.push_back(int_div(4, 2));
+      auto completed = as_completed(std::move(tasks));
+      REQUIRE_THROWS_AS(co_await completed.next(), std::overflow_error);
+      // The others are still there.
+      auto [index, value] = co_await completed.next();
+      REQUIRE(index == 1);
+      REQUIRE(value == 2);
+      REQUIRE(completed.empty());
+    }());
+  }
+
+  GIVEN("destroyed before the tasks finish") {
+    auto before_wait = get_event_loop().time();
+    asyncio::run([&]() -> Task<> {
+      std::vector<Task<int>> tasks;
+      tasks.push_back(after(10));
+      tasks.push_back(after(1000));
+      auto completed = as_completed(std::move(tasks));
+      auto [index, value] = co_await completed.next();
+      REQUIRE(index == 0);
+    }());
+    // The slow one was destroyed with it, and so was its timer.
+    REQUIRE(get_event_loop().time() - before_wait < 500ms);
+  }
+}
+
+SCENARIO("race of tasks") {
+  bool loser_done = false;
+  auto after = [&](int ms) -> Task<int> {
+    co_await asyncio::sleep(ms * 1ms);
+    loser_done = ms > 10;
+    co_return ms;
+  };
+
+  GIVEN("a range of tasks") {
+    auto before_wait = get_event_loop().time();
+    asyncio::run([&]() -> Task<> {
+      std::vector<Task<int>> tasks;
+      for (int ms : {300, 10, 200}) {
+        tasks.push_back(after(ms));
+      }
+      auto [index, value] = co_await race(std::move(tasks));
+      REQUIRE(index == 1);
+      REQUIRE(value == 10);
+    }());
+    // The others were destroyed with their timers, at once.
+    REQUIRE(get_event_loop().time() - before_wait < 100ms);
+    REQUIRE(!loser_done);
+  }
+
+  GIVEN("awaitables of different types") {
+    asyncio::run([&]() -> Task<> {
+      auto winner = co_await race(after(300), asyncio::sleep(10ms));
+      REQUIRE(winner.index() == 1);
+      auto task = after(10);
+      winner = co_await race(task, asyncio::sleep(300ms));
+      REQUIRE(std::get<0>(winner) == 10);
+    }());
+    REQUIRE(!loser_done);
+  }
+
+  GIVEN("the first one throws") {
+    asyncio::run([&]() -> Task<> {
+      REQUIRE_THROWS_AS(co_await race(int_div(4, 0), after(300)),
+                        std::overflow_error);
+    }());
+    REQUIRE(!loser_done);
+  }
+}
+
+SCENARIO("hedged requests") {
+  // The n-th attempt answers after latencies[n], or throws if it is negative.
+  std::vector<int> latencies;
+  size_t n_attempts = 0;
+  size_t n_answered = 0;
+  auto request = [&]() -> Task<size_t> {
+    size_t attempt = n_attempts++;
+    int ms = attempt < latencies.size() ? latencies[attempt] : 0;
+    if (ms < 0) {
+      throw std::runtime_error("attempt failed");
+    }
+    co_await asyncio::sleep(ms * 1ms);
+    ++n_answered;
+    co_return attempt;
+  };
+
+  GIVEN("a first attempt which answers in time") {
+    latencies = {5};
+    REQUIRE(asyncio::run(hedge(request, 50ms)) == 0);
+    REQUIRE(n_attempts == 1);
+  }
+
+  GIVEN("a slow first attempt") {
+    latencies = {300, 10};
+    auto before_wait = get_event_loop().time();
+    REQUIRE(asyncio::run(hedge(request, 20ms)) == 1);
+    REQUIRE(get_event_loop().time() - before_wait < 200ms);
+    // The first one was cancelled.
+    REQUIRE(n_attempts == 2);
+    REQUIRE(n_answered == 1);
+  }
+
+  GIVEN("failed attempts") {
+    latencies = {-1, 10};
+    // Tried again at once, without waiting for the delay.
+    auto before_wait = get_event_loop().time();
+    REQUIRE(asyncio::run(hedge(request, 1s)) == 1);
+    REQUIRE(get_event_loop().time() - before_wait < 500ms);
+
+    latencies = {-1, -1, -1};
+    n_attempts = 0;
+    REQUIRE_THROWS_AS(asyncio::run(hedge(request, 10ms, 3)),
+                      std::runtime_error);
+    REQUIRE(n_attempts == 3);
+  }
+
+  GIVEN("a delay following the latencies") {
+    HedgeLatency latency(1s, 95, 10);
+    latencies.assign(10, 2);
+    asyncio::run([&]() -> Task<> {
+      for (int i = 0; i < 10; ++i) {
+        co_await hedge(request, latency);
+      }
+    }());
+    REQUIRE(latency.snapshot().count == 10);
+    REQUIRE(latency.delay() >= 1ms);
+    REQUIRE(latency.delay() < 100ms);
+  }
+}
+
+SCENARIO("task group") {
+  std::vector<int> finished;
+  auto after = [&](int ms) -> Task<int> {
+    co_await asyncio::sleep(ms * 1ms);
+    finished.push_back(ms);
+    co_return ms;
+  };
+
+  GIVEN("children which finish at different times") {
+    asyncio::run([&]() -> Task<> {
+      TaskGroup group;
+      for (int ms : {10, 60, 50}) {
+        group.spawn(after(ms));
+      }
+      REQUIRE(group.size() == 3);
+      co_await asyncio::sleep(30ms);
+      // The first one is gone without anyone looking for it.
+      REQUIRE(group.size() == 2);
+      co_await group.wait();
+      REQUIRE(group.empty());
+    }());
+    REQUIRE(finished == std::vector<int>{10, 50, 60});
+  }
+
+  GIVEN("a child throws") {
+    auto before_wait = get_event_loop().time();
+    asyncio::run([&]() -> Task<> {
+      TaskGroup group;
+      group.spawn(after(300));
+      group.spawn(int_div(4, 0));
+      REQUIRE_THROWS_AS(co_await group.wait(), std::overflow_error);
+      REQUIRE(group.empty());
+      // Usable again.
+      group.spawn(after(10));
+      co_await group.wait();
+    }());
+    // The sibling was cancelled with its timer.
+    REQUIRE(get_event_loop().time() - before_wait < 100ms);
+    REQUIRE(finished == std::vector<int>{10});
+  }
+
+  GIVEN("a group which ignores errors") {
+    asyncio::run([&]() -> Task<> {
+      TaskGroup group{ChildError::IGNORE};
+      group.spawn(int_div(4, 0));
+      group.spawn(after(10));
+      co_await group.wait();
+    }());
+    REQUIRE(finished == std::vector<int>{10});
+  }
+
+  GIVEN("the group is cancelled") {
+    auto before_wait = get_event_loop().time();
+    asyncio::run([&]() -> Task<> {
+      TaskGroup group;
+      group.spawn(after(300));
+      co_await asyncio::sleep(1ms);
+      group.cancel();
+      REQUIRE(group.empty());
+    }());
+    REQUIRE(get_event_loop().time() - before_wait < 100ms);
+    REQUIRE(finished.empty());
+  }
+
+  GIVEN("the task owning the group is cancelled") {
+    auto before_wait = get_event_loop().time();
+    asyncio::run([&]() -> Task<> {
+      auto owner = [&]() -> Task<> {
+        TaskGroup group;
+        group.spawn(after(300));
+        co_await group.wait();
+      };
+      auto task = create_scheduled_task(owner());
+      co_await asyncio::sleep(1ms);
+      // The group is destroyed with the frame, and cancels its children.
+      task.cancel();
+    }());
+    REQUIRE(get_event_loop().time() - before_wait < 100ms);
+    REQUIRE(finished.empty());
+  }
+}
+
+SCENARIO("detached tasks") {
+  std::vector<int> finished;
+  auto after = [&](int ms) -> Task<int> {
+    co_await asyncio::sleep(ms * 1ms);
+    finished.push_back(ms);
+    co_return ms;
+  };
+  auto& loop = get_event_loop();
+
+  GIVEN("tasks nobody keeps") {
+    asyncio::run([&]() -> Task<> {
+      spawn(after(20));
+      spawn(after(10));
+      REQUIRE(loop.spawned_count() == 2);
+      co_return;
+    }());
+    REQUIRE(finished == std::vector<int>{10, 20});
+    REQUIRE(loop.spawned_count() == 0);
+  }
+
+  GIVEN("a task which finishes without suspending") {
+    asyncio::run([&]() -> Task<> {
+      spawn(int_div(4, 2));
+      REQUIRE(loop.spawned_count() == 1);
+      co_await asyncio::yield();
+      // Freed when it finished, without another run of the loop.
+      REQUIRE(loop.spawned_count() == 0);
+    }());
+  }
+
+  GIVEN("exceptions go to the handler of the loop") {
+    std::vector<std::exception_ptr> unhandled;
+    loop.set_exception_handler(
+        [&](std::exception_ptr e) { unhandled.push_back(e); });
+    asyncio::run([&]() -> Task<> {
+      spawn(int_div(4, 0));
+      spawn(after(10));
+      co_return;
+    }());
+    loop.set_exception_handler({});
+    REQUIRE(unhandled.size() == 1);
+    REQUIRE_THROWS_AS(std::rethrow_exception(unhandled[0]),
+                      std::overflow_error);
+    REQUIRE(finished == std::vector<int>{10});
+  }
+
+  GIVEN("tasks left at shutdown") {
+    spawn(after(300));
+    spawn(after(10));
+    REQUIRE(loop.spawned_count() == 2);
+    loop.cancel_spawned();
+    REQUIRE(loop.spawned_count() == 0);
+    asyncio::run(asyncio::sleep(20ms));
+    REQUIRE(finished.empty());
+  }
+}
+
+SCENARIO("test run_on_threads") {
+  GIVEN("a loop per thread") {
+    auto loops = asyncio::run_on_threads(4, [](size_t index) -> Task<void*> {
+      co_await asyncio::sleep(10ms);
+      auto&& [a, b] = co_await gather(square((int64_t)index), sleep(1ms));
+      REQUIRE(a == index * index);
+      co_return &get_event_loop();
+    });
+    REQUIRE(loops.size() == 4);
+    std::sort(loops.begin(), loops.end());
+    REQUIRE(std::unique(loops.begin(), loops.end()) == loops.end());
+    REQUIRE(std::find(loops.begin(), loops.end(), &get_event_loop()) ==
+            loops.end());
+  }
+
+  GIVEN("exception in one of the threads") {
+    REQUIRE_THROWS_AS(asyncio::run_on_threads(2,
+                                              [](size_t index) -> Task<> {
+                                                if (index == 1) {
+                                                  co_await int_div(1, 0);
+                                                }
+                                              }),
+                      std::overflow_error);
+  }
+}
+
+#ifdef USE_WORK_STEALING
+Task<int64_t> parallel_fib(int n) {
+  if (n < 2) {
+    co_return n;
+  }
+  auto [a, b] = co_await gather(parallel_fib(n - 1), parallel_fib(n - 2));
+  co_return a + b;
+}
+
+Task<int64_t> sum_of_squares(int n) {
+  std::vector<ScheduledTask<Task<int64_t>>> tasks;
+  for (int i = 0; i < n; ++i) {
+    tasks.push_back(create_scheduled_task(square(i)));
+  }
+  int64_t sum = 0;
+  for (auto& task : tasks) {
+    sum += co_await task;
+  }
+  co_return sum;
+}
+
+SCENARIO("test WorkStealingScheduler") {
+  WorkStealingScheduler scheduler(4);
+  REQUIRE(scheduler.size() == 4);
+
+  GIVEN("a tree of tasks with gather") {
+    REQUIRE(scheduler.run(parallel_fib(20)) == 6765);
+    auto id = scheduler.run([]() -> Task<std::thread::id> {
+      co_return std::this_thread::get_id();
+    }());
+    REQUIRE(id != std::this_thread::get_id());
+  }
+
+  GIVEN("scheduled tasks awaited after they are done") {
+    REQUIRE(scheduler.run(sum_of_squares(1000)) == 332'833'500);
+  }
+
+  GIVEN("gather of a range of tasks") {
+    REQUIRE(scheduler.run([]() -> Task<int64_t> {
+      std::vector<Task<int64_t>> tasks;
+      for (int i = 0; i < 20; ++i) {
+        tasks.push_back(parallel_fib(i));
+      }
+      int64_t sum = 0;
+      for (auto fib : co_await gather(std::move(tasks))) {
+        sum += fib;
+      }
+      co_return sum;
+    }()) == 10945);
+  }
+
+  GIVEN("exception in a child of gather") {
+    REQUIRE_THROWS_AS(scheduler.run([]() -> Task<> {
+                        co_await gather(parallel_fib(15), int_div(1, 0));
+                      }()),
+                      std::overflow_error);
+  }
+}
+#endif
+
+SCENARIO("test run_in_executor") {
+  ThreadPool pool(2);
+
+  GIVEN("result and exception of a job") {
+    asyncio::run([&]() -> Task<> {
+      auto id = co_await run_in_executor(
+          pool, [] { return std::this_thread::get_id(); });
+      REQUIRE(id != std::this_thread::get_id());
+      REQUIRE_THROWS_AS(co_await run_in_executor(pool,
+                                                 []() -> int {
+                                                   throw std::overflow_error(
+                                                       "in a job");
+                                                 }),
+                        std::overflow_error);
+    }());
+  }
+
+  GIVEN("the loop keeps running while a job blocks") {
+    int ticks = 0;
+    asyncio::run([&]() -> Task<> {
+      auto tick = [&]() -> Task<> {
+        for (int i = 0; i < 5; ++i) {
+          co_await asyncio::sleep_for(10ms);
+          ++ticks;
+        }
+      };
+      auto ticker = create_scheduled_task(tick());
+      co_await run_in_executor(pool,
+                               [] { std::this_thread::sleep_for(100ms); });
+      REQUIRE(ticks == 5);
+    }());
+  }
+
+  GIVEN("the caller is destroyed before the job ends") {
+    bool job_done = false;
+    asyncio::run([&]() -> Task<> {
+      auto wait_job = [&]() -> Task<> {
+        co_await run_in_executor(pool, [&] {
+          std::this_thread::sleep_for(50ms);
+          job_done = true;
+        });
+      };
+      auto waiter = create_scheduled_task(wait_job());
+      co_await asyncio::sleep_for(10ms);
+      waiter.cancel();
+    }());
+    // The loop waited for the job, but didn't resume the destroyed caller.
+    REQUIRE(job_done);
+  }
+}
+
 #ifndef NO_IO
 
+SCENARIO("test io operations of event loop") {
+  int fds[2];
+  REQUIRE(pipe2(fds, O_NONBLOCK) == 0);
+  auto [read_fd, write_fd] = fds;
+  std::string_view message = "ping";
+
+  SECTION("read after wait_io_event") {
+    asyncio::run([&]() -> Task<> {
+      auto read = [&]() -> Task<std::string> {
+        co_await get_event_loop().wait_io_event(
+            {.fd = read_fd, .event_type = EPOLLIN, .handle_info = {}});
+        std::string buf(message.size(), 0);
+        REQUIRE(::read(read_fd, buf.data(), buf.size()) == message.size());
+        co_return buf;
+      };
+      auto reader = create_scheduled_task(read());
+      co_await asyncio::sleep(10ms);
+      REQUIRE(::write(write_fd, message.data(), message.size()) ==
+              message.size());
+      REQUIRE(co_await reader == message);
+    }());
+  }
+
+  SECTION("async_read & async_write") {
+    asyncio::run([&]() -> Task<> {
+      auto read = [&]() -> Task<std::string> {
+        std::string buf(16, 0);
+        auto n = co_await get_event_loop().async_read(read_fd, buf.data(),
+                                                      buf.size());
+        REQUIRE(n >= 0);
+        buf.resize(n);
+        co_return buf;
+      };
+      auto reader = create_scheduled_task(read());
+      co_await asyncio::sleep(10ms);
+      auto n = co_await get_event_loop().async_write(write_fd, message.data(),
+                                                     message.size());
+      REQUIRE(n == message.size());
+      REQUIRE(co_await reader == message);
+    }());
+  }
+
+  SECTION("read a registered fd several times") {
+    auto io = get_event_loop().make_io_registration(read_fd);
+    asyncio::run([&]() -> Task<> {
+      auto read = [&]() -> Task<std::string> {
+        std::string result;
+        while (result.size() < 3 * message.size()) {
+          std::string buf(16, 0);
+          auto n = co_await get_event_loop().async_read(io, buf.data(),
+                                                        buf.size());
+          if (n == -EAGAIN) {
+            continue;
+          }
+          REQUIRE(n > 0);
+          result.append(buf.data(), n);
+        }
+        co_return result;
+      };
+      auto reader = create_scheduled_task(read());
+      for (int i = 0; i < 3; ++i) {
+        co_await asyncio::sleep(5ms);
+        REQUIRE(::write(write_fd, message.data(), message.size()) ==
+                message.size());
+      }
+      REQUIRE(co_await reader == "pingpingping");
+    }());
+    // An idle registration doesn't keep the event loop running.
+    asyncio::run(asyncio::sleep(1ms));
+  }
+
+#ifndef USE_IO_URING
+  SECTION("reads which never block use up the coop budget") {
+    auto& loop = get_event_loop();
+    loop.set_coop_budget(4);
+    constexpr size_t kBytes = 64;
+    std::string data(kBytes, 'x');
+    REQUIRE(::write(write_fd, data.data(), data.size()) == kBytes);
+    auto io = loop.make_io_registration(read_fd);
+    size_t n_read = 0;
+    size_t read_when_ticked = 0;
+    asyncio::run([&]() -> Task<> {
+      auto read = [&]() -> Task<> {
+        char c;
+        while (n_read < kBytes) {
+          auto n = co_await loop.async_read(io, &c, 1);
+          REQUIRE(n == 1);
+          ++n_read;
+        }
+      };
+      auto tick = [&]() -> Task<> {
+        read_when_ticked = n_read;
+        co_return;
+      };
+      auto reader = create_scheduled_task(read());
+      auto ticker = create_scheduled_task(tick());
+      co_await reader;
+      co_await ticker;
+    }());
+    // The reader yielded before it was done, so the other task ran.
+    REQUIRE(read_when_ticked > 0);
+    REQUIRE(read_when_ticked < kBytes);
+    loop.set_coop_budget(128);
+  }
+#endif
+
+  SECTION("cancel a pending read") {
+    asyncio::run([&]() -> Task<> {
+      char buf[16];
+      auto read = [&]() -> Task<> {
+        co_await get_event_loop().async_read(read_fd, buf, sizeof buf);
+        FAIL("should be cancelled");
+      };
+      auto reader = create_scheduled_task(read());
+      co_await asyncio::sleep(10ms);
+      reader.cancel();
+    }());
+    REQUIRE(::write(write_fd, message.data(), message.size()) ==
+            message.size());
+  }
+
+  SECTION("async_read_some & async_write_some of a stream") {
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+    asyncio::run([&]() -> Task<> {
+      Stream a(fds[0]);
+      Stream b(fds[1]);
+      const auto& stats = get_frame_pool().stats();
+      char buf[16];
+      size_t n_read = 0;
+      auto read = [&]() -> Task<> {
+        auto frames = stats.hits + stats.misses;
+        n_read = co_await b.async_read_some(buf);
+        // Neither the wait nor the read created a Task.
+        REQUIRE(stats.hits + stats.misses == frames);
+      };
+      auto reader = create_scheduled_task(read());
+      co_await asyncio::sleep_for(10ms);
+      REQUIRE(n_read == 0);
+      auto n_written = co_await a.async_write_some(message);
+      REQUIRE(n_written == message.size());
+      co_await reader;
+      REQUIRE(std::string_view(buf, n_read) == message);
+
+      a.close();
+      n_read = co_await b.async_read_some(buf);
+      REQUIRE(n_read == 0);  // EOF
+    }());
+  }
+
+  SECTION("a stream of a blocking fd") {
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    asyncio::run([&]() -> Task<> {
+      Stream a(fds[0]);
+      Stream b(fds[1]);
+      REQUIRE(fcntl(fds[1], F_GETFL) & O_NONBLOCK);
+      char buf[16];
+      size_t n_read = 0;
+      auto read = [&]() -> Task<> {
+        n_read = co_await b.async_read_some(buf);
+      };
+      auto reader = create_scheduled_task(read());
+      // The read waits on the loop instead of blocking it.
+      co_await asyncio::sleep_for(10ms);
+      REQUIRE(n_read == 0);
+      co_await a.async_write_some(message);
+      co_await reader;
+      REQUIRE(std::string_view(buf, n_read) == message);
+    }());
+  }
+
+  SECTION("more ready fds than max io events") {
+    auto& loop = get_event_loop();
+    auto max_events = loop.max_io_events();
+    loop.set_max_io_events(2);
+    constexpr size_t kPairs = 5;
+    std::vector<int> fds(kPairs * 2);
+    for (size_t i = 0; i < kPairs; ++i) {
+      REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0,
+                         &fds[i * 2]) == 0);
+    }
+    size_t n_woken = 0;
+    asyncio::run([&]() -> Task<> {
+      std::vector<Stream> streams;
+      streams.reserve(fds.size());
+      for (int fd : fds) {
+        streams.emplace_back(fd);
+      }
+      auto read = [&](Stream& stream) -> Task<> {
+        char c;
+        co_await stream.async_read_some({&c, 1});
+        ++n_woken;
+      };
+      std::vector<ScheduledTask<Task<>>> readers;
+      for (size_t i = 0; i < kPairs; ++i) {
+        readers.push_back(create_scheduled_task(read(streams[i * 2])));
+      }
+      co_await asyncio::sleep_for(10ms);
+      char c = 'x';
+      for (size_t i = 0; i < kPairs; ++i) {
+        co_await streams[i * 2 + 1].async_write_some({&c, 1});
+      }
+      for (auto& reader : readers) {
+        co_await reader;
+      }
+    }());
+    // All of them are woken up, two per selector wakeup.
+    REQUIRE(n_woken == kPairs);
+    loop.set_max_io_events(max_events);
+  }
+
+  close(read_fd);
+  close(write_fd);
+}
+
 SCENARIO("echo server & client") {
   bool is_called = false;
   constexpr std::string_view message = "hello world!";
@@ -414,6 +1458,8 @@ SCENARIO("echo server & client") {
     };
 
     auto srv = create_scheduled_task(echo_server());
+    // Let the server start listening first: echo_client() may run at once.
+    co_await asyncio::sleep(10ms);
     co_await echo_client();
     srv.cancel();
   }());
@@ -421,4 +1467,221 @@ SCENARIO("echo server & client") {
   REQUIRE(is_called);
 }
 
+SCENARIO("test frame pool") {
+  const auto& stats = get_frame_pool().stats();
+
+  GIVEN("reuse the frame of a finished task") {
+    auto one = []() -> Task<int> { co_return 1; };
+    REQUIRE(asyncio::run(one()) == 1);
+    auto [hits, misses, _] = stats;
+    REQUIRE(stats.bytes_held > 0);
+    REQUIRE(asyncio::run(one()) == 1);
+    REQUIRE(stats.hits == hits + 1);
+    REQUIRE(stats.misses == misses);
+  }
+
+  GIVEN("a burst of frames of one size") {
+    FramePool pool;
+    std::vector<void*> frames(size_t{1} << 18);
+    for (auto& frame : frames) {
+      frame = pool.allocate(64);
+    }
+    for (auto* frame : frames) {
+      pool.deallocate(frame, 64);
+    }
+    // The size class keeps a quarter of the pool, so the others still fit.
+    REQUIRE(pool.stats().bytes_held == (size_t{16} << 20) / 4);
+    pool.deallocate(pool.allocate(128), 128);
+    REQUIRE(pool.stats().bytes_held == (size_t{16} << 20) / 4 + 128);
+  }
+
+  GIVEN("steady-state echo allocates no frames") {
+    // Whatever the tests before left in the pool, e.g. a full size class.
+    get_frame_pool().trim();
+    REQUIRE(stats.bytes_held == 0);
+    constexpr size_t kWarmUp = 10;
+    constexpr size_t kRoundTrips = 100;
+    size_t misses = 0;
+    asyncio::run([&]() -> Task<> {
+      auto handle_echo = [](Stream stream) -> Task<> {
+        while (true) {
+          auto data = co_await stream.read(100);
+          if (data.empty()) {
+            break;
+          }
+          co_await stream.write(data);
+        }
+      };
+      auto echo_server = [&]() -> Task<> {
+        auto server =
+            co_await asyncio::start_server(handle_echo, "127.0.0.1", 8890);
+        co_await server.serve_forever();
+      };
+      auto srv = create_scheduled_task(echo_server());
+      co_await asyncio::sleep(10ms);
+
+      auto stream = co_await asyncio::open_connection("127.0.0.1", 8890);
+      Stream::Buffer message{'p', 'i', 'n', 'g'};
+      for (size_t i = 0; i < kWarmUp + kRoundTrips; ++i) {
+        if (i == kWarmUp) {
+          misses = stats.misses;
+        }
+        co_await stream.write(message);
+        auto data = co_await stream.read(100);
+        REQUIRE(data == message);
+      }
+      misses = stats.misses - misses;
+      srv.cancel();
+    }());
+    REQUIRE(misses == 0);
+  }
+}
+
+SCENARIO("servers sharing a port with reuse_port") {
+  auto handle_echo = [](Stream stream) -> Task<> {
+    co_await stream.write(co_await stream.read(100));
+  };
+  std::latch listening(2);
+  asyncio::run_on_threads(2, [&]() -> Task<> {
+    auto server =
+        co_await asyncio::start_server(handle_echo, "127.0.0.1", 8889, true);
+    listening.arrive_and_wait();
+  });
+  REQUIRE_THROWS(asyncio::run_on_threads(2, [&]() -> Task<> {
+    auto server =
+        co_await asyncio::start_server(handle_echo, "127.0.0.1", 8889);
+    co_await asyncio::sleep(20ms);
+  }));
+}
+
+#ifdef USE_TRACING
+Task<int> traced_child(int fd) {
+  co_await get_event_loop().wait_io_event({.fd = fd, .event_type = EPOLLIN});
+  char c = 0;
+  [[maybe_unused]] auto n = ::read(fd, &c, 1);
+  co_return c;
+}
+
+SCENARIO("dump a chrome trace") {
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  asyncio::run([&]() -> Task<> {
+    auto child = create_scheduled_task(traced_child(fds[0]));
+    co_await asyncio::sleep(1ms);
+    [[maybe_unused]] auto n = ::write(fds[1], "x", 1);
+    int c = co_await child;
+    REQUIRE(c == 'x');
+  }());
+  close(fds[0]);
+  close(fds[1]);
+
+  std::ostringstream out;
+  dump_chrome_trace(out);
+  auto trace = out.str();
+  REQUIRE(trace.starts_with("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+  REQUIRE(trace.ends_with("]}\n"));
+  // GCC and Clang name it differently.
+  REQUIRE(trace.find("traced_child(int)\",\"pid\":1") != std::string::npos);
+  REQUIRE(trace.find("\"suspended_at\":\"" __FILE__) != std::string::npos);
+  REQUIRE(trace.find("\"ph\":\"b\",\"cat\":\"io\",\"name\":\"io wait at " __FILE__) !=
+          std::string::npos);
+  REQUIRE(trace.find("\"ph\":\"e\",\"cat\":\"io\"") != std::string::npos);
+  REQUIRE(trace.find("\"name\":\"schedule\"") != std::string::npos);
+  REQUIRE(trace.find("\"name\":\"create\"") != std::string::npos);
+}
+#endif
+
+#ifdef USE_TASK_STATS
+Task<int> counted_reader(int fd) {
+  co_await get_event_loop().wait_io_event({.fd = fd, .event_type = EPOLLIN});
+  char c = 0;
+  [[maybe_unused]] auto n = ::read(fd, &c, 1);
+  std::this_thread::sleep_for(10ms);  // holds the loop
+  co_return c;
+}
+
+SCENARIO("task stats by coroutine") {
+  reset_task_stats();
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  asyncio::run([&]() -> Task<> {
+    auto reader = create_scheduled_task(counted_reader(fds[0]));
+    std::this_thread::sleep_for(5ms);  // reader is in the ready queue
+    co_await asyncio::sleep(20ms);     // reader waits for IO
+    [[maybe_unused]] auto n = ::write(fds[1], "x", 1);
+    int c = co_await reader;
+    REQUIRE(c == 'x');
+  }());
+  close(fds[0]);
+  close(fds[1]);
+
+  auto stats = get_task_stats();
+  auto reader = std::find_if(stats.begin(), stats.end(), [](const auto& e) {
+    return e.function.find("counted_reader(") != std::string::npos;
+  });
+  REQUIRE(reader != stats.end());
+  // The most running, without the 10ms of reader in its parent.
+  REQUIRE(reader == stats.begin());
+  REQUIRE(reader->file == __FILE__);
+  REQUIRE(reader->stats.tasks == 1);
+  REQUIRE(reader->stats.resumes == 2);
+  REQUIRE(reader->stats.running >= 10ms);
+  REQUIRE(reader->stats.ready_wait >= 5ms);
+  REQUIRE(reader->stats.io_wait >= 15ms);
+
+  reset_task_stats();
+  REQUIRE(get_task_stats().empty());
+}
+#endif
+
+SCENARIO("call into a running loop from other threads") {
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+  EventLoop* loop = nullptr;
+  std::latch started(1);
+  std::vector<int> calls;  // only used by the loop thread
+  std::jthread loop_thread([&] {
+    asyncio::run([&]() -> Task<> {
+      loop = &get_event_loop();
+      Stream stop(fds[0]);
+      started.count_down();
+      // Nothing else is pending, so the loop waits in select() infinitely.
+      char c;
+      co_await stop.async_read_some({&c, 1});
+    }());
+  });
+  started.wait();
+
+  constexpr int kThreads = 4;
+  constexpr int kCalls = 1000;
+  {
+    std::vector<std::jthread> producers;
+    for (int t = 0; t < kThreads; ++t) {
+      producers.emplace_back([&, t] {
+        for (int i = 0; i < kCalls; ++i) {
+          loop->call_soon_threadsafe(
+              [&calls, value = t * kCalls + i] { calls.push_back(value); });
+        }
+      });
+    }
+  }
+  auto square_future = run_coroutine_threadsafe(square(7), *loop);
+  REQUIRE(square_future.get() == 49);
+  auto div_future = run_coroutine_threadsafe(int_div(1, 0), *loop);
+  REQUIRE_THROWS_AS(div_future.get(), std::overflow_error);
+
+  loop->call_soon_threadsafe([&] {
+    [[maybe_unused]] auto n = ::write(fds[1], "x", 1);
+  });
+  loop_thread.join();
+  close(fds[1]);
+
+  REQUIRE(calls.size() == kThreads * kCalls);
+  // Calls from the same thread run in order.
+  std::vector<int> next(kThreads, 0);
+  for (int value : calls) {
+    REQUIRE(value % kCalls == next[value / kCalls]++);
+  }
+}
+
 #endif
@@ -0,0 +1,106 @@
+#include <asyncio/timer/timer_heap.h>
+#include <asyncio/timer/timing_wheel.h>
+
+// 3rd
+#include <catch2/catch_test_macros.hpp>
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace asyncio;
+using namespace std::chrono_literals;
+using MSDuration = std::chrono::milliseconds;
+
+namespace {
+
+// Insert timers with random deadlines, cancel some of them, then advance the
+// time like EventLoop does. Every timer left must fire at the first expire()
+// after its deadline, and only once.
+template <typename TimerQueue>
+void check_random_timers(bool far_deadlines) {
+  constexpr size_t kTimers = 20000;
+  std::mt19937_64 gen(42);
+  std::uniform_int_distribution<int64_t> near(0, 100'000);
+  std::uniform_int_distribution<int64_t> far(0, int64_t{1} << 38);
+
+  TimerQueue timers;
+  auto entries = std::make_unique<TimerEntry[]>(kTimers);
+  std::vector<MSDuration> deadlines(kTimers);
+  std::vector<int> fired(kTimers, 0);
+  for (size_t i = 0; i < kTimers; ++i) {
+    deadlines[i] = MSDuration(far_deadlines && i % 2 ? far(gen) : near(gen));
+    timers.insert(entries[i], deadlines[i]);
+  }
+  REQUIRE(timers.size() == kTimers);
+  for (size_t i = 0; i < kTimers; i += 3) {
+    timers.erase(entries[i]);
+  }
+  REQUIRE(timers.size() == kTimers - (kTimers + 2) / 3);
+
+  MSDuration now{0};
+  std::uniform_int_distribution<int64_t> step(0, 2000);
+  bool ok = !entries[0].queued();
+  while (!timers.empty()) {
+    auto before = now;
+    // Sometimes sleep until the next expiry, as the event loop does.
+    if (gen() % 2) {
+      now = std::max(now, *timers.next_expiry());
+    } else {
+      now += MSDuration(step(gen));
+    }
+    timers.expire(now, [&](TimerEntry& entry) {
+      size_t i = &entry - entries.get();
+      ++fired[i];
+      ok = ok && !entry.queued() && before <= deadlines[i] &&
+           deadlines[i] < now;
+    });
+  }
+  REQUIRE(ok);
+  for (size_t i = 0; i < kTimers; ++i) {
+    ok = ok && fired[i] == (i % 3 == 0 ? 0 : 1);
+  }
+  REQUIRE(ok);
+}
+
+}  // namespace
+
+SCENARIO("test timer queues") {
+  SECTION("timer heap") {
+    check_random_timers<TimerHeap>(false);
+    check_random_timers<TimerHeap>(true);
+  }
+
+  SECTION("timing wheel") {
+    check_random_timers<TimingWheel>(false);
+    check_random_timers<TimingWheel>(true);
+  }
+
+  SECTION("timing wheel fires in order") {
+    TimingWheel timers;
+    TimerEntry a, b, c, d;
+    timers.insert(c, 5000ms);
+    timers.insert(a, 10ms);
+    timers.insert(d, 5000ms);
+    timers.insert(b, 70ms);
+    std::vector<TimerEntry*> result;
+    auto collect = [&](TimerEntry& entry) { result.push_back(&entry); };
+    timers.expire(10ms, collect);
+    REQUIRE(result.empty());
+    REQUIRE(timers.next_expiry() == 11ms);
+    timers.expire(6000ms, collect);
+    std::vector<TimerEntry*> expected{&a, &b, &c, &d};
+    REQUIRE(result == expected);
+    REQUIRE(timers.empty());
+    REQUIRE(timers.next_expiry() == std::nullopt);
+
+    // A timer in the past fires at the next expire().
+    timers.insert(a, 100ms);
+    REQUIRE(timers.next_expiry() <= 6001ms);
+    timers.expire(6001ms, collect);
+    REQUIRE(timers.empty());
+  }
+}